@@ -3,14 +3,23 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
 #include <topology/lsvineyard.h>
+#include <topology/flat-order.h>
+#include <topology/hybrid-chain.h>
+#include <topology/binary-complex.h>
+#include <utilities/thread-pool.h>
+#include <utilities/profile.h>
+#include <boost/cstdint.hpp>
 #include <boost/iterator/counting_iterator.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 #include <boost/lambda/lambda.hpp>
 
-#include <time.h>
-
 namespace bl = boost::lambda;
 
 
@@ -26,21 +35,233 @@ struct SubscriptFunctor: public std::unary_function<Vertex, VertexValue>
 };
 typedef     SubscriptFunctor                            VertexEvaluator;
 typedef     std::vector<VertexVector>                   VertexVectorVector;
-typedef     LSVineyard<Vertex, VertexEvaluator>         PLVineyard;
+typedef     Simplex<Vertex>                             PLSimplex;
+#if FLAT_ORDER
+typedef     FlatOrderConsistencyContainer<>             PLOrderContainer;   // contiguous storage with 32-bit order indices
+#else
+typedef     OrderConsistencyContainer<>                 PLOrderContainer;
+#endif
+#if FLAT_ORDER && HYBRID_CHAINS
+typedef     HybridChains<>                              PLChains;           // switch to bitsets for long, dense chains
+#else
+typedef     VectorChains<>                              PLChains;
+#endif
+typedef     LSVineyard<Vertex, VertexEvaluator, PLSimplex,
+                       Filtration<PLSimplex>, PLOrderContainer, PLChains> PLVineyard;
 typedef     PLVineyard::Simplex                         Smplx;              // gotta start using namespaces
 
-std::vector<std::vector<std::vector<double>>> vineyards(const std::vector<std::vector<double> >& vertices_values, const std::string& complex_fn, const int& discard_inf, const int& trajectories){
+#ifndef EXPLICIT_CROSSINGS
+#define EXPLICIT_CROSSINGS 0                                                    // 1 replays the crossings offline; vines may differ on ties
+#endif
 
-  clock_t start, end;
+#ifndef TRAIL_COMPACTION
+#define TRAIL_COMPACTION 1.01                                                   // see LSVineyard::set_compaction_threshold(); 0 never compacts
+#endif
 
-  // Read in the complex
-  PLVineyard::LSFiltration simplices;
+// A pair of simplices at the first or the last frame of a segment, with its vine
+struct PLLivePair
+{
+  std::pair<Smplx::VertexContainer, Smplx::VertexContainer>   simplices;
+  Dimension                                                   dimension;
+  Knee                                                        knee;
+  VineId                                                      vine;
+
+  bool operator<(const PLLivePair& other) const { return simplices < other.simplices; }
+};
+typedef     std::vector<PLLivePair>                     PLLivePairVector;
+
+struct PLLivePairValueComparison
+{
+  bool operator()(const PLLivePair& p1, const PLLivePair& p2) const
+  {
+    if (p1.dimension != p2.dimension) return p1.dimension < p2.dimension;
+    if (p1.knee.birth != p2.knee.birth) return p1.knee.birth < p2.knee.birth;
+    return p1.knee.death < p2.knee.death;
+  }
+};
+
+// Vineyard over the frames [first, last], computed independently of the other segments
+struct PLSegment
+{
+  PLSegment(const PLVineyard::LSFiltration& simplices, size_t f, size_t l): filtration(simplices), first(f), last(l) {}
+
+  PLVineyard::LSFiltration          filtration;
+  std::unique_ptr<PLVineyard>       vineyard;
+  size_t                            first, last;
+  PLLivePairVector                  starts, ends;
+  size_t                            peak_memory = 0;                    // bytes, see memory_footprint()
+  Profile                           profile;                            // of the thread that computes the segment, when it is not the caller's
+};
+
+// Estimate (in bytes) of the memory held by the vineyard: elements, their cycles and trails, simplices, and knees
+size_t memory_footprint(const PLVineyard& v){
+  const PLVineyard::Persistence& p = v.persistence();
+  size_t bytes = p.size()*(sizeof(PLVineyard::Persistence::Element) + sizeof(Smplx)) + v.vineyard().knees()*(sizeof(Knee) + sizeof(VineId));
+  for (PLVineyard::iterator cur = p.begin(); cur != p.end(); ++cur)
+    bytes += (cur->cycle.size() + cur->trail.size())*sizeof(PLVineyard::Index);
+  return bytes;
+}
+
+void live_pairs(PLVineyard& v, bool at_end, PLLivePairVector& result){
+  PLVineyard::Vnrd::LivePairVector pairs;
+  v.vineyard().live_pairs(v.persistence().begin(), v.persistence().end(), pairs);
+  for (size_t i = 0; i < pairs.size(); ++i){
+    PLLivePair p;
+    p.simplices = std::make_pair(v.pfmap(pairs[i].birth).vertices(), v.pfmap(pairs[i].death).vertices());
+    p.dimension = v.pfmap(pairs[i].birth).dimension();
+    p.knee      = at_end ? v.vineyard().back(pairs[i].vine) : v.vineyard().front(pairs[i].vine);
+    p.vine      = pairs[i].vine;
+    result.push_back(p);
+  }
+  std::sort(result.begin(), result.end());
+}
+
+// boundaries: the boundary table of the simplices, in the order of segment.filtration (see load_binary_complex()), or 0 to look the faces up
+void setup_segment(PLSegment& segment, const VertexVectorVector& vertices, const double& rebuild_threshold, const int& homology, const double& epsilon, const BinaryComplex* boundaries = 0){
+  VertexEvaluator veval(vertices[segment.first]);
+  PLVineyard::VertexComparison vcmp(veval);
+  PLVineyard::SimplexComparison scmp(vcmp);
+  std::vector<PLVineyard::LSFIndex> simplices;          // in the order of the table; the indices stay valid through the sort
+  if (boundaries)
+    for (PLVineyard::LSFIndex i = segment.filtration.begin(); i != segment.filtration.end(); ++i)
+      simplices.push_back(i);
+  {
+    Profile::Scope scope(Profile::Sort);
+    segment.filtration.sort(scmp);
+  }
+  if (boundaries)
+    segment.vineyard.reset(new PLVineyard(boost::counting_iterator<Vertex>(0), boost::counting_iterator<Vertex>(vertices[segment.first].size()), segment.filtration, simplices, *boundaries, veval, homology));
+  else
+    segment.vineyard.reset(new PLVineyard(boost::counting_iterator<Vertex>(0), boost::counting_iterator<Vertex>(vertices[segment.first].size()), segment.filtration, veval, homology));
+  segment.vineyard->set_rebuild_threshold(rebuild_threshold);
+  if (TRAIL_COMPACTION > 0)
+    segment.vineyard->set_compaction_threshold(TRAIL_COMPACTION);
+  segment.vineyard->vineyard().set_epsilon(epsilon);
+  segment.peak_memory = memory_footprint(*segment.vineyard);
+  live_pairs(*segment.vineyard, false, segment.starts);
+}
+
+void run_segment(PLSegment& segment, const VertexVectorVector& vertices){
+  for (size_t i = segment.first + 1; i <= segment.last; ++i){
+    VertexEvaluator veval(vertices[i]);
+    segment.vineyard->compute_vineyard(veval, EXPLICIT_CROSSINGS);
+    segment.peak_memory = std::max(segment.peak_memory, memory_footprint(*segment.vineyard));
+  }
+  live_pairs(*segment.vineyard, true, segment.ends);
+}
+
+// Vines live at the end of one segment continue the vines of the same pairs of simplices at the start of the next.
+// Ties in vertex values may pair different simplices in the two segments; those pairs are matched if their values
+// are equal. The vines left over die on the diagonal, and the pairs left over start new vines from it (see stitch()).
+PLVineyard::Vnrd::VineContinuations match_segments(const PLSegment& s1, const PLSegment& s2){
+  PLVineyard::Vnrd::VineContinuations continuations;
+  PLLivePairVector ends, starts;
+  PLLivePairVector::const_iterator e = s1.ends.begin(), s = s2.starts.begin();
+  while (e != s1.ends.end() && s != s2.starts.end()){
+    if (*e < *s)        ends.push_back(*e++);
+    else if (*s < *e)   starts.push_back(*s++);
+    else                continuations.push_back(std::make_pair((e++)->vine, (s++)->vine));
+  }
+  ends.insert(ends.end(), e, s1.ends.end());
+  starts.insert(starts.end(), s, s2.starts.end());
+
+  PLLivePairValueComparison vcmp;
+  std::sort(ends.begin(), ends.end(), vcmp);
+  std::sort(starts.begin(), starts.end(), vcmp);
+  e = ends.begin(); s = starts.begin();
+  while (e != ends.end() || s != starts.end()){
+    if (s == starts.end() || (e != ends.end() && vcmp(*e, *s)))   continuations.push_back(std::make_pair((e++)->vine, NoVine));
+    else if (e == ends.end() || vcmp(*s, *e))                       continuations.push_back(std::make_pair(NoVine, (s++)->vine));
+    else                                                            continuations.push_back(std::make_pair((e++)->vine, (s++)->vine));
+  }
+  return continuations;
+}
+
+// Reads the simplices of dimension at most max_dimension (all of them, if negative), in the order of the file, so that they match its boundary table
+void load_binary_complex(const BinaryComplex& complex, PLVineyard::LSFiltration& simplices, const int& max_dimension = -1){
+  Profile::Scope scope(Profile::Parse);
+  for (size_t i = 0; i < complex.skeleton_size(max_dimension); ++i)
+    simplices.push_back(Smplx(complex.vertices_begin(i), complex.vertices_end(i)));
+}
+
+// Reads the vertex values of the frames stored in a BinaryComplex
+void load_binary_frames(const BinaryComplex& complex, VertexVectorVector& vertices){
+  Profile::Scope scope(Profile::Parse);
+  if (!complex.frames())
+    throw std::runtime_error("The binary complex has no frames");
+  for (size_t f = 0; f < complex.frames(); ++f)
+    vertices.push_back(VertexVector(complex.values(f), complex.values(f) + complex.vertices()));
+}
+
+// Reads the simplices of dimension at most max_dimension (all of them, if negative), from a file in Dionysus text format or a BinaryComplex
+void read_complex(const std::string& complex_fn, PLVineyard::LSFiltration& simplices, const int& max_dimension = -1){
+  if (BinaryComplex::detect(complex_fn)){
+    load_binary_complex(BinaryComplex(complex_fn), simplices, max_dimension);
+    return;
+  }
+
+  Profile::Scope  scope(Profile::Parse);
   std::ifstream   in(complex_fn.c_str());
   std::string     line;
   while (std::getline(in, line)){
     std::istringstream  strin(line);
-    simplices.push_back(Smplx(std::istream_iterator<Vertex>(strin), std::istream_iterator<Vertex>()));
+    Smplx s((std::istream_iterator<Vertex>(strin)), std::istream_iterator<Vertex>());
+    if (max_dimension < 0 || s.dimension() <= max_dimension)
+      simplices.push_back(s);
+  }
+}
+
+// Same as read_complex(), but a BinaryComplex stays open in binary, so that its boundary table can be used
+void read_complex(const std::string& complex_fn, PLVineyard::LSFiltration& simplices, BinaryComplex& binary, const int& max_dimension = -1){
+  if (BinaryComplex::detect(complex_fn)){
+    binary.open(complex_fn);
+    load_binary_complex(binary, simplices, max_dimension);
+  } else
+    read_complex(complex_fn, simplices, max_dimension);
+}
+
+// Throws std::invalid_argument unless simplex i can be read as complex_vertices[complex_offsets[i]], ..., complex_vertices[complex_offsets[i+1] - 1]:
+// the offsets start at 0, never decrease, and end at the number of vertices, and every vertex is a valid Vertex
+void check_complex(const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets){
+  if (complex_offsets.empty() ? !complex_vertices.empty() : complex_offsets.front() != 0)
+    throw std::invalid_argument("The offsets of the simplices must start at 0");
+  for (size_t i = 0; i + 1 < complex_offsets.size(); ++i)
+    if (complex_offsets[i+1] < complex_offsets[i])
+      throw std::invalid_argument("The offsets of the simplices must not decrease");
+  if (!complex_offsets.empty() && complex_offsets.back() != boost::int64_t(complex_vertices.size()))
+    throw std::invalid_argument("The offsets of the simplices must end at the number of vertices");
+  for (size_t i = 0; i < complex_vertices.size(); ++i)
+    if (complex_vertices[i] < 0 || complex_vertices[i] > boost::int64_t(std::numeric_limits<Vertex>::max()))
+      throw std::invalid_argument("Vertex " + std::to_string(complex_vertices[i]) + " is out of range");
+}
+
+// Same as read_complex(), from memory: simplex i has the vertices complex_vertices[complex_offsets[i]], ..., complex_vertices[complex_offsets[i+1] - 1]
+// (see check_complex())
+void build_complex(const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, PLVineyard::LSFiltration& simplices, const int& max_dimension = -1){
+  Profile::Scope scope(Profile::Parse);
+  check_complex(complex_vertices, complex_offsets);
+  for (size_t i = 0; i + 1 < complex_offsets.size(); ++i){
+    std::vector<boost::int64_t>::const_iterator bg = complex_vertices.begin() + complex_offsets[i], end = complex_vertices.begin() + complex_offsets[i+1];
+    if (max_dimension < 0 || end - bg <= max_dimension + 1)
+      simplices.push_back(Smplx(bg, end));
   }
+}
+
+// rebuild_threshold: recompute a frame from scratch when its vertices cross more than this many times per simplex
+// segments: split the frames into this many contiguous segments, computed in parallel and stitched together;
+//           the diagrams do not depend on it, but the vines may: at the frame two segments share, pairs with tied
+//           values are continued by value, which need not be how a single pass connects them
+// homology: compute only the vines of this dimension, on the (homology + 1)-skeleton (all dimensions, if negative)
+// epsilon: drop the vines whose persistence never exceeds epsilon, and collapse the knees of the others within epsilon of the diagonal
+// The vineyard of all the frames ends up in the returned segment; only read its vines, the vertex values are gone.
+// The simplices are expected to be restricted to the (homology + 1)-skeleton already (see read_complex()).
+// boundaries: the boundary table of the simplices (see setup_segment()), if any
+// stats: if not null, receives the counts of the work done, added up over the segments (see VineyardStats)
+// The phases are timed into the profile active on the calling thread, if any (see Profile), including those of the other threads.
+std::unique_ptr<PLSegment> compute_vineyards(const std::vector<std::vector<double> >& vertices_values, const PLVineyard::LSFiltration& simplices, const double& rebuild_threshold, const int& segments, const int& homology, const double& epsilon, const BinaryComplex* boundaries = 0, VineyardStats* stats = 0){
+  if (vertices_values.empty())
+    throw std::runtime_error("There must be at least one frame");
+
   //std::cout << "Simplices read:" << std::endl;
   //std::copy(simplices.begin(), simplices.end(), std::ostream_iterator<Smplx>(std::cout, "\n"));
 
@@ -57,27 +278,391 @@ std::vector<std::vector<std::vector<double>>> vineyards(const std::vector<std::v
   //      std::cout << std::endl;
   //}
 
-  // Setup the vineyard
-  start = clock();
-  VertexEvaluator veval(vertices[0]);
-  PLVineyard::VertexComparison vcmp(veval);
-  PLVineyard::SimplexComparison scmp(vcmp);
-  simplices.sort(scmp);
-  PLVineyard v(boost::counting_iterator<Vertex>(0), boost::counting_iterator<Vertex>(vertices[0].size()), simplices, veval);
-  end = clock(); 
-  std::cout << double(end-start)/CLOCKS_PER_SEC << std::endl;
-
-  // Compute vineyard
-  for (size_t i = 1; i < vertices.size(); ++i){
-    veval = VertexEvaluator(vertices[i]);
-    v.compute_vineyard(veval);
+  // Split the frames
+  size_t k = std::max<size_t>(1, std::min<size_t>(segments, n - 1));
+  std::vector<std::unique_ptr<PLSegment>> segs;
+  for (size_t i = 0; i < k; ++i)
+    segs.emplace_back(new PLSegment(simplices, i*(n - 1)/k, (i + 1)*(n - 1)/k));
+
+  if (k == 1){
+    // Setup the vineyard, and compute it
+    setup_segment(*segs[0], vertices, rebuild_threshold, homology, epsilon, boundaries);
+    run_segment(*segs[0], vertices);
+  } else {
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < k; ++i)
+      workers.emplace_back([&segs, &vertices, &rebuild_threshold, &homology, &epsilon, boundaries, i](){
+        Profile::Activation activation(segs[i]->profile);
+        setup_segment(*segs[i], vertices, rebuild_threshold, homology, epsilon, boundaries);
+        run_segment(*segs[i], vertices);
+      });
+    for (size_t i = 0; i < k; ++i)
+      workers[i].join();
+    if (Profile::current())
+      for (size_t i = 0; i < k; ++i)
+        *Profile::current() += segs[i]->profile;
+    if (stats)
+      for (size_t i = 1; i < k; ++i)
+        *stats += segs[i]->vineyard->stats();
+
+    // Stitch the segments, from the back, so that the vines of each segment stay where they are until it's stitched
+    for (size_t i = k - 1; i > 0; --i)
+      segs[i-1]->vineyard->vineyard().stitch(segs[i]->vineyard->vineyard(), match_segments(*segs[i-1], *segs[i]), segs[i]->first - segs[i-1]->first);
   }
+  if (stats)
+    *stats += segs[0]->vineyard->stats();
+  return std::move(segs[0]);
+}
+
+// See compute_vineyards() for the parameters
+std::vector<std::vector<std::vector<double>>> vineyards(const std::vector<std::vector<double> >& vertices_values, const PLVineyard::LSFiltration& simplices, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0, const BinaryComplex* boundaries = 0, VineyardStats* stats = 0){
+  std::unique_ptr<PLSegment> segment = compute_vineyards(vertices_values, simplices, rebuild_threshold, segments, homology, epsilon, boundaries, stats);
+  const PLVineyard& v = *segment->vineyard;
 
   // Retrieve vineyard
+  Profile::Scope scope(Profile::Extraction);
   std::vector<std::vector<std::vector<double>>> V;
   if (trajectories)  V = v.vineyard().get_vines(discard_inf);
-  else  V = v.vineyard().get_dgms(discard_inf, n);
+  else  V = v.vineyard().get_dgms(discard_inf, vertices_values.size());
 
   return V;
 
 }
+
+// Reads the complex from the file complex_fn (see read_complex())
+std::vector<std::vector<std::vector<double>>> vineyards(const std::vector<std::vector<double> >& vertices_values, const std::string& complex_fn, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0, VineyardStats* stats = 0){
+  PLVineyard::LSFiltration simplices;
+  BinaryComplex binary;
+  read_complex(complex_fn, simplices, binary, homology < 0 ? -1 : homology + 1);
+  return vineyards(vertices_values, simplices, discard_inf, trajectories, rebuild_threshold, segments, homology, epsilon, binary.is_open() ? &binary : 0, stats);
+}
+
+// Takes the complex from memory, as in build_complex()
+std::vector<std::vector<std::vector<double>>> vineyards(const std::vector<std::vector<double> >& vertices_values, const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0, VineyardStats* stats = 0){
+  PLVineyard::LSFiltration simplices;
+  build_complex(complex_vertices, complex_offsets, simplices, homology < 0 ? -1 : homology + 1);
+  return vineyards(vertices_values, simplices, discard_inf, trajectories, rebuild_threshold, segments, homology, epsilon, 0, stats);
+}
+
+// Writes to checkpoint_fn a checkpoint of the vineyard of the simplices at the frame values, i.e., of their initial reduction
+// (see LSVineyard::save()), from which vineyards_from_checkpoint() starts; see compute_vineyards() for the parameters
+void save_checkpoint(const std::string& checkpoint_fn, const VertexVector& values, const PLVineyard::LSFiltration& simplices, const int& homology = -1, const double& epsilon = 0, const BinaryComplex* boundaries = 0){
+  VertexVectorVector vertices(1, values);
+  PLSegment segment(simplices, 0, 0);
+  setup_segment(segment, vertices, Infinity, homology, epsilon, boundaries);
+  std::ofstream out(checkpoint_fn.c_str(), std::ios::binary);
+  if (!out)
+    throw std::runtime_error("Cannot write " + checkpoint_fn);
+  segment.vineyard->save(out);
+  if (!out)
+    throw std::runtime_error("Cannot write " + checkpoint_fn);
+}
+
+// Reads the complex from the file complex_fn (see read_complex())
+void save_checkpoint(const std::string& checkpoint_fn, const VertexVector& values, const std::string& complex_fn, const int& homology = -1, const double& epsilon = 0){
+  PLVineyard::LSFiltration simplices;
+  BinaryComplex binary;
+  read_complex(complex_fn, simplices, binary, homology < 0 ? -1 : homology + 1);
+  save_checkpoint(checkpoint_fn, values, simplices, homology, epsilon, binary.is_open() ? &binary : 0);
+}
+
+// Takes the complex from memory, as in build_complex()
+void save_checkpoint(const std::string& checkpoint_fn, const VertexVector& values, const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const int& homology = -1, const double& epsilon = 0){
+  PLVineyard::LSFiltration simplices;
+  build_complex(complex_vertices, complex_offsets, simplices, homology < 0 ? -1 : homology + 1);
+  save_checkpoint(checkpoint_fn, values, simplices, homology, epsilon);
+}
+
+// vineyards() of the frames, starting from the checkpoint written by save_checkpoint() at the first of them, instead of from a reduction;
+// the complex, homology and epsilon are those of the checkpoint
+std::vector<std::vector<std::vector<double>>> vineyards_from_checkpoint(const std::vector<std::vector<double> >& vertices_values, const std::string& checkpoint_fn, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, VineyardStats* stats = 0){
+  if (vertices_values.empty())
+    throw std::runtime_error("There must be at least one frame");
+  VertexVectorVector vertices(vertices_values.begin(), vertices_values.end());
+  PLSegment segment(PLVineyard::LSFiltration(), 0, vertices.size() - 1);
+  {
+    Profile::Scope scope(Profile::Parse);
+    std::ifstream in(checkpoint_fn.c_str(), std::ios::binary);
+    if (!in)
+      throw std::runtime_error("Cannot open " + checkpoint_fn);
+    segment.vineyard.reset(new PLVineyard(in, segment.filtration, VertexEvaluator(vertices[0])));
+  }
+  segment.vineyard->set_rebuild_threshold(rebuild_threshold);
+  run_segment(segment, vertices);
+  if (stats)
+    *stats += segment.vineyard->stats();
+
+  Profile::Scope scope(Profile::Extraction);
+  if (trajectories)   return segment.vineyard->vineyard().get_vines(discard_inf);
+  else                return segment.vineyard->vineyard().get_dgms(discard_inf, vertices.size());
+}
+
+// The vines of vineyards(), flattened (see Vineyard::get_flat_vines())
+struct FlatVineyard
+{
+  std::vector<double>                             knees;              // birth, death, time, row by row
+  std::vector<boost::int64_t>                     offsets;            // the knees of vine i are the rows offsets[i], ..., offsets[i+1] - 1
+  std::vector<boost::int64_t>                     dimensions;
+  VineyardStats                                   stats;
+};
+
+FlatVineyard flat_vineyards(const std::vector<std::vector<double> >& vertices_values, const PLVineyard::LSFiltration& simplices, const int& discard_inf, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0, const BinaryComplex* boundaries = 0){
+  FlatVineyard result;
+  std::unique_ptr<PLSegment> segment = compute_vineyards(vertices_values, simplices, rebuild_threshold, segments, homology, epsilon, boundaries, &result.stats);
+  Profile::Scope scope(Profile::Extraction);
+  segment->vineyard->vineyard().get_flat_vines(discard_inf, result.knees, result.offsets, result.dimensions);
+  return result;
+}
+
+FlatVineyard flat_vineyards(const std::vector<std::vector<double> >& vertices_values, const std::string& complex_fn, const int& discard_inf, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0){
+  PLVineyard::LSFiltration simplices;
+  BinaryComplex binary;
+  read_complex(complex_fn, simplices, binary, homology < 0 ? -1 : homology + 1);
+  return flat_vineyards(vertices_values, simplices, discard_inf, rebuild_threshold, segments, homology, epsilon, binary.is_open() ? &binary : 0);
+}
+
+FlatVineyard flat_vineyards(const std::vector<std::vector<double> >& vertices_values, const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const int& discard_inf, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0){
+  PLVineyard::LSFiltration simplices;
+  build_complex(complex_vertices, complex_offsets, simplices, homology < 0 ? -1 : homology + 1);
+  return flat_vineyards(vertices_values, simplices, discard_inf, rebuild_threshold, segments, homology, epsilon);
+}
+
+// The vineyards of the complex and the frames stored in the BinaryComplex binary_fn
+std::vector<std::vector<std::vector<double>>> binary_vineyards(const std::string& binary_fn, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0, VineyardStats* stats = 0){
+  BinaryComplex binary(binary_fn);
+  PLVineyard::LSFiltration simplices;
+  VertexVectorVector vertices;
+  load_binary_complex(binary, simplices, homology < 0 ? -1 : homology + 1);
+  load_binary_frames(binary, vertices);
+  return vineyards(vertices, simplices, discard_inf, trajectories, rebuild_threshold, segments, homology, epsilon, &binary, stats);
+}
+
+FlatVineyard flat_binary_vineyards(const std::string& binary_fn, const int& discard_inf, const double& rebuild_threshold = Infinity, const int& segments = 1, const int& homology = -1, const double& epsilon = 0){
+  BinaryComplex binary(binary_fn);
+  PLVineyard::LSFiltration simplices;
+  VertexVectorVector vertices;
+  load_binary_complex(binary, simplices, homology < 0 ? -1 : homology + 1);
+  load_binary_frames(binary, vertices);
+  return flat_vineyards(vertices, simplices, discard_inf, rebuild_threshold, segments, homology, epsilon, &binary);
+}
+
+// Writes the complex, in Dionysus text format, and the frames (possibly none) as a BinaryComplex
+void save_binary_complex(const std::string& binary_fn, const std::string& complex_fn, const VertexVectorVector& vertices_values){
+  std::vector<std::vector<BinaryComplex::Id> > simplices;
+  std::ifstream   in(complex_fn.c_str());
+  if (!in)
+    throw std::runtime_error("Cannot open " + complex_fn);
+  std::string     line;
+  while (std::getline(in, line)){
+    std::istringstream  strin(line);
+    simplices.push_back(std::vector<BinaryComplex::Id>((std::istream_iterator<BinaryComplex::Id>(strin)), std::istream_iterator<BinaryComplex::Id>()));
+    if (simplices.back().empty()) simplices.pop_back();
+  }
+  BinaryComplex::write(binary_fn, simplices, vertices_values);
+}
+
+// Same, with the complex given as in build_complex()
+void save_binary_complex(const std::string& binary_fn, const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const VertexVectorVector& vertices_values){
+  check_complex(complex_vertices, complex_offsets);
+  std::vector<std::vector<BinaryComplex::Id> > simplices;
+  for (size_t i = 0; i + 1 < complex_offsets.size(); ++i)
+    simplices.push_back(std::vector<BinaryComplex::Id>(complex_vertices.begin() + complex_offsets[i], complex_vertices.begin() + complex_offsets[i+1]));
+  BinaryComplex::write(binary_fn, simplices, vertices_values);
+}
+
+struct VineyardResult
+{
+  std::vector<std::vector<std::vector<double>>>   vineyard;
+  double                                          seconds;            // wall-clock time of the job
+  size_t                                          peak_memory;        // bytes, see memory_footprint()
+  VineyardStats                                   stats;
+  Profile                                         profile;            // phases of the job (see Profile)
+};
+
+// Computes the vineyards of the jobs (complex i, vertices_values[i]) on a pool of threads (all the cores if threads is 0);
+// complex i is read from complex_fns[i], as in read_complex(), or, if that is empty, taken from complex_vertices[i] and
+// complex_offsets[i], as in build_complex(). Results are in the order of the jobs.
+std::vector<VineyardResult> batch_vineyards(const std::vector<std::string>& complex_fns, const std::vector<std::vector<boost::int64_t> >& complex_vertices, const std::vector<std::vector<boost::int64_t> >& complex_offsets, const std::vector<VertexVectorVector>& vertices_values, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& threads = 0, const int& homology = -1, const double& epsilon = 0){
+  std::vector<VineyardResult> results(complex_fns.size());
+  WorkStealingPool pool(threads);
+  pool.for_each(complex_fns.size(), [&](size_t i){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Profile::Activation activation(results[i].profile);
+
+    const VertexVectorVector& vertices = vertices_values[i];
+    if (vertices.empty())
+      throw std::runtime_error("There must be at least one frame");
+    PLVineyard::LSFiltration simplices;
+    if (!complex_fns[i].empty())  read_complex(complex_fns[i], simplices, homology < 0 ? -1 : homology + 1);
+    else                          build_complex(complex_vertices[i], complex_offsets[i], simplices, homology < 0 ? -1 : homology + 1);
+
+    PLSegment segment(simplices, 0, vertices.size() - 1);
+    setup_segment(segment, vertices, rebuild_threshold, homology, epsilon);
+    run_segment(segment, vertices);
+
+    VineyardResult& result = results[i];
+    Profile::Scope scope(Profile::Extraction);
+    if (trajectories)   result.vineyard = segment.vineyard->vineyard().get_vines(discard_inf);
+    else                result.vineyard = segment.vineyard->vineyard().get_dgms(discard_inf, vertices.size());
+    result.peak_memory = segment.peak_memory;
+    result.stats = segment.vineyard->stats();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  });
+  return results;
+}
+
+// Same, with every complex read from a file
+std::vector<VineyardResult> batch_vineyards(const std::vector<std::string>& complex_fns, const std::vector<VertexVectorVector>& vertices_values, const int& discard_inf, const int& trajectories, const double& rebuild_threshold = Infinity, const int& threads = 0, const int& homology = -1, const double& epsilon = 0){
+  std::vector<std::vector<boost::int64_t> > none(complex_fns.size());
+  return batch_vineyards(complex_fns, none, none, vertices_values, discard_inf, trajectories, rebuild_threshold, threads, homology, epsilon);
+}
+
+// Computes the vineyard one frame at a time, handing the knees (if trajectories) or the diagrams of the frames over
+// as they become final; the vineyard holds on to about buffer knees at most (plus two per live vine)
+class VineyardStream: public VineyardSink
+{
+  public:
+    typedef   std::pair<double, Diagram>                  TimedDiagram;
+
+    VineyardStream(const std::vector<std::vector<double> >& vertices_values, const std::string& complex_fn, const int& discard_inf, const int& trajectories, const int& buffer = 0, const int& homology = -1, const double& epsilon = 0):
+      vertices(vertices_values.begin(), vertices_values.end()), discard(discard_inf), trajectories(trajectories),
+      buffer(buffer), homology(homology), epsilon(epsilon), next(0){
+      read_complex(complex_fn, simplices, homology < 0 ? -1 : homology + 1);
+    }
+
+    // Takes the complex from memory, as in build_complex()
+    VineyardStream(const std::vector<std::vector<double> >& vertices_values, const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const int& discard_inf, const int& trajectories, const int& buffer = 0, const int& homology = -1, const double& epsilon = 0):
+      vertices(vertices_values.begin(), vertices_values.end()), discard(discard_inf), trajectories(trajectories),
+      buffer(buffer), homology(homology), epsilon(epsilon), next(0){
+      build_complex(complex_vertices, complex_offsets, simplices, homology < 0 ? -1 : homology + 1);
+    }
+
+    // Sets up the vineyard (on the first call), or computes the next frame (after the last one, passes on the rest of
+    // the knees); returns false once there is nothing left to do
+    bool step(){
+      if (next > vertices.size()) return false;
+      if (next == 0){
+        if (vertices.empty())
+          throw std::runtime_error("There must be at least one frame");
+        segment.reset(new PLSegment(simplices, 0, vertices.size() - 1));
+        setup_segment(*segment, vertices, Infinity, homology, epsilon);
+        PLVineyard::Vnrd& v = segment->vineyard->vineyard();
+        v.set_sink(this, buffer);
+        v.report_diagram(segment->vineyard->persistence().begin(), segment->vineyard->persistence().end());
+      } else if (next < vertices.size()){
+        VertexEvaluator veval(vertices[next]);
+        segment->vineyard->compute_vineyard(veval, EXPLICIT_CROSSINGS);
+      } else
+        segment->vineyard->vineyard().finish();
+      ++next;
+      return true;
+    }
+
+    // Moves the knees (vine, dimension, birth, death, time) passed on so far into result
+    void take_knees(std::vector<std::vector<double> >& result)        { result.clear(); result.swap(knees); }
+    void take_diagrams(std::vector<TimedDiagram>& result)             { result.clear(); result.swap(diagrams); }
+
+    // Counts of the work done so far (see VineyardStats)
+    VineyardStats stats() const                                       { return segment ? segment->vineyard->stats() : VineyardStats(); }
+
+    virtual void knee(VineId v, Dimension d, const Knee& k){
+      if (!trajectories || (discard && k.is_infinite())) return;
+      double row[] = { double(v), double(d), k.birth, k.death, k.time };
+      knees.push_back(std::vector<double>(row, row + 5));
+    }
+
+    virtual void diagram(RealType time, const Diagram& dgm){
+      if (trajectories) return;
+      diagrams.push_back(TimedDiagram(time, dgm));
+      if (!discard) return;
+      Diagram& d = diagrams.back().second;
+      for (size_t i = 0; i < d.size(); ++i){
+        size_t k = 0;
+        for (size_t j = 0; j < d[i].size(); j += 2)
+          if (d[i][j+1] != Infinity){ d[i][k++] = d[i][j]; d[i][k++] = d[i][j+1]; }
+        d[i].resize(k);
+      }
+    }
+
+  private:
+    PLVineyard::LSFiltration                    simplices;
+    VertexVectorVector                          vertices;
+    int                                         discard, trajectories, buffer, homology;
+    double                                      epsilon;
+    size_t                                      next;                   // frame to compute next
+    std::unique_ptr<PLSegment>                  segment;
+    std::vector<std::vector<double> >           knees;
+    std::vector<TimedDiagram>                   diagrams;
+};
+
+// A vineyard that grows one frame at a time, as the frames become available: the complex is read once, reduced at the
+// first frame, and every frame after that extends the vines from the previous one. The diagram and the vines so far can
+// be read at any point in between.
+class LiveVineyard
+{
+  public:
+    // See compute_vineyards() for the parameters; the complex is read as in read_complex()
+    LiveVineyard(const std::string& complex_fn, const double& rebuild_threshold = Infinity, const int& homology = -1, const double& epsilon = 0):
+      values(2), rebuild_threshold(rebuild_threshold), homology(homology), epsilon(epsilon), frames(0){
+      read_complex(complex_fn, simplices, binary, homology < 0 ? -1 : homology + 1);
+    }
+
+    // Takes the complex from memory, as in build_complex()
+    LiveVineyard(const std::vector<boost::int64_t>& complex_vertices, const std::vector<boost::int64_t>& complex_offsets, const double& rebuild_threshold = Infinity, const int& homology = -1, const double& epsilon = 0):
+      values(2), rebuild_threshold(rebuild_threshold), homology(homology), epsilon(epsilon), frames(0){
+      build_complex(complex_vertices, complex_offsets, simplices, homology < 0 ? -1 : homology + 1);
+    }
+
+    // Sets up the vineyard at the first frame; computes the vineyard from the previous frame to this one at the others.
+    // The frames alternate between the two vectors of values, since the vineyard evaluates the previous one until it is done.
+    void push_frame(const std::vector<double>& frame_values){
+      VertexVector& v = values[frames % 2];
+      if (frames && frame_values.size() != values[(frames - 1) % 2].size())
+        throw std::runtime_error("Every frame must have the same number of vertices");
+      v.assign(frame_values.begin(), frame_values.end());
+      if (frames == 0){
+        segment.reset(new PLSegment(simplices, 0, 0));
+        setup_segment(*segment, values, rebuild_threshold, homology, epsilon, binary.is_open() ? &binary : 0);
+        simplices.clear();                                                  // the segment keeps its own copy
+        binary.close();
+      } else {
+        VertexEvaluator veval(v);
+        segment->vineyard->compute_vineyard(veval, EXPLICIT_CROSSINGS);
+      }
+      ++frames;
+    }
+
+    // The diagram of dimension dim at the last frame, births and deaths interleaved (see Vineyard::current_diagram())
+    std::vector<double> diagram(const int& dim, const int& discard_inf) const{
+      std::vector<double> result;
+      if (!frames) return result;
+      std::vector<std::vector<RealType> > dgm;
+      segment->vineyard->vineyard().current_diagram(segment->vineyard->persistence().begin(), segment->vineyard->persistence().end(), dgm);
+      if (dim < 0 || size_t(dim) >= dgm.size()) return result;
+      for (size_t j = 0; j < dgm[dim].size(); j += 2){
+        if (discard_inf && dgm[dim][j+1] == Infinity) continue;
+        result.push_back(dgm[dim][j]);
+        result.push_back(dgm[dim][j+1]);
+      }
+      return result;
+    }
+
+    // The vines so far, as in vineyards(); the time of a knee is the index of its frame
+    std::vector<std::vector<std::vector<double>>> vines(const int& discard_inf) const{
+      if (!frames) return std::vector<std::vector<std::vector<double>>>();
+      return segment->vineyard->vineyard().get_vines(discard_inf);
+    }
+
+    size_t size() const                                                 { return frames; }
+    VineyardStats stats() const                                         { return segment ? segment->vineyard->stats() : VineyardStats(); }
+
+  private:
+    PLVineyard::LSFiltration                    simplices;
+    BinaryComplex                               binary;
+    VertexVectorVector                          values;                 // the last two frames
+    double                                      rebuild_threshold;
+    int                                         homology;
+    double                                      epsilon;
+    size_t                                      frames;                 // frames pushed so far
+    std::unique_ptr<PLSegment>                  segment;
+};
@@ -2,9 +2,400 @@ from cython cimport numeric
 from cython cimport int
 from libcpp.vector cimport vector
 from libcpp.string cimport string
+from libcpp.utility cimport pair
+from libcpp cimport bool
+from libc.stdint cimport int64_t
+from cpython cimport Py_buffer
+import numpy as np
+import time
+
+cdef extern from "utilities/profile.h":
+    ctypedef enum ProfilePhase "Profile::Phase":
+        ProfileConversion "Profile::Conversion"
+        ProfilePhases "Profile::Phases"
+
+    cdef cppclass Profile:
+        void add(ProfilePhase, double)
+        size_t calls(ProfilePhase)
+        double seconds(ProfilePhase)
+        @staticmethod
+        const char* name(ProfilePhase)
+
+    cdef cppclass ProfileActivation "Profile::Activation":
+        ProfileActivation(Profile&)
 
 cdef extern from "dionysus_vineyards.hpp":
-    vector[vector[vector[double]]] vineyards(vector[vector[double]], string, int, int)
+    cdef struct VineyardStats:
+        size_t transpositions
+        size_t different_dimension
+        size_t relocations
+        size_t case12
+        size_t case12s
+        size_t case111
+        size_t case112
+        size_t case22
+        size_t case211
+        size_t case212
+        size_t case32
+        size_t case31
+        size_t case4
+        size_t switches
+        size_t chain_additions
+        size_t max_cycle
+        size_t max_trail
+        size_t frames
+        size_t rebuilds
+        size_t compactions
+        size_t kinetic_events
+        size_t event_groups
+        size_t vertex_transpositions
+        size_t attachment_changes
+        size_t knees
+
+    vector[vector[vector[double]]] vineyards(vector[vector[double]], string, int, int, double, int, int, double, VineyardStats*) except +
+    vector[vector[vector[double]]] vineyards(vector[vector[double]], vector[int64_t], vector[int64_t], int, int, double, int, int, double, VineyardStats*) except +
+
+    cdef cppclass FlatVineyard:
+        vector[double] knees
+        vector[int64_t] offsets
+        vector[int64_t] dimensions
+        VineyardStats stats
+    FlatVineyard flat_vineyards(vector[vector[double]], string, int, double, int, int, double) except +
+    FlatVineyard flat_vineyards(vector[vector[double]], vector[int64_t], vector[int64_t], int, double, int, int, double) except +
+
+    vector[vector[vector[double]]] binary_vineyards(string, int, int, double, int, int, double, VineyardStats*) except +
+    FlatVineyard flat_binary_vineyards(string, int, double, int, int, double) except +
+    void write_binary_complex "save_binary_complex"(string, string, vector[vector[double]]) except +
+    void write_binary_complex "save_binary_complex"(string, vector[int64_t], vector[int64_t], vector[vector[double]]) except +
+    void write_checkpoint "save_checkpoint"(string, vector[double], string, int, double) except +
+    void write_checkpoint "save_checkpoint"(string, vector[double], vector[int64_t], vector[int64_t], int, double) except +
+    vector[vector[vector[double]]] vineyards_from_checkpoint(vector[vector[double]], string, int, int, double, VineyardStats*) except +
+
+    cdef cppclass VineyardResult:
+        vector[vector[vector[double]]] vineyard
+        double seconds
+        size_t peak_memory
+        VineyardStats stats
+        Profile profile
+    vector[VineyardResult] batch_vineyards(vector[string], vector[vector[int64_t]], vector[vector[int64_t]], vector[vector[vector[double]]], int, int, double, int, int, double) except + nogil
+
+    cdef cppclass VineyardStream:
+        VineyardStream(vector[vector[double]], string, int, int, int, int, double) except +
+        VineyardStream(vector[vector[double]], vector[int64_t], vector[int64_t], int, int, int, int, double) except +
+        bool step() except +
+        void take_knees(vector[vector[double]]&)
+        void take_diagrams(vector[pair[double, vector[vector[double]]]]&)
+        VineyardStats stats()
+
+    cdef cppclass LiveVineyard:
+        LiveVineyard(string, double, int, double) except +
+        LiveVineyard(vector[int64_t], vector[int64_t], double, int, double) except +
+        void push_frame(vector[double]) except +
+        vector[double] diagram(int, int)
+        vector[vector[vector[double]]] vines(int)
+        size_t size()
+        VineyardStats stats()
+
+cdef class _VectorBuffer:
+    """Exposes a vector, taken over by swap(), through the buffer protocol, so that NumPy can view it without a copy."""
+    cdef vector[double] doubles
+    cdef vector[int64_t] ints
+    cdef bint floating
+    cdef int ndim
+    cdef Py_ssize_t shape[2]
+    cdef Py_ssize_t strides[2]
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if self.floating:
+            buffer.buf = <void*> self.doubles.data()
+            buffer.format = 'd'
+            buffer.itemsize = sizeof(double)
+        else:
+            buffer.buf = <void*> self.ints.data()
+            buffer.format = 'q'
+            buffer.itemsize = sizeof(int64_t)
+        buffer.obj = self
+        buffer.ndim = self.ndim
+        buffer.shape = self.shape
+        buffer.strides = self.strides
+        buffer.len = self.shape[0] * self.strides[0]
+        buffer.suboffsets = NULL
+        buffer.readonly = 0
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+cdef _VectorBuffer _knee_array(vector[double]& knees):
+    cdef _VectorBuffer b = _VectorBuffer()
+    b.doubles.swap(knees)
+    b.floating = True
+    b.ndim = 2
+    b.shape[0] = b.doubles.size() // 3
+    b.shape[1] = 3
+    b.strides[0] = 3 * sizeof(double)
+    b.strides[1] = sizeof(double)
+    return b
+
+cdef _VectorBuffer _index_array(vector[int64_t]& indices):
+    cdef _VectorBuffer b = _VectorBuffer()
+    b.ints.swap(indices)
+    b.floating = False
+    b.ndim = 1
+    b.shape[0] = b.ints.size()
+    b.strides[0] = sizeof(int64_t)
+    return b
+
+cdef void _complex_vectors(complex, vector[int64_t]& vertices, vector[int64_t]& offsets):
+    """Fills (vertices, offsets) with the simplices of complex, given either as such a pair of arrays, where simplex i
+    has the vertices vertices[offsets[i]:offsets[i+1]], or as a list of per-dimension arrays, the simplices of dimension d
+    being the rows of an array with d + 1 columns."""
+    if isinstance(complex, tuple):
+        flat_vertices, flat_offsets = complex
+    else:
+        blocks = [np.asarray(splxs, dtype=np.int64).reshape(len(splxs), -1) for splxs in complex if len(splxs) > 0]
+        flat_vertices = np.concatenate([b.ravel() for b in blocks]) if blocks else np.zeros(0, dtype=np.int64)
+        sizes = np.concatenate([np.full(len(b), b.shape[1], dtype=np.int64) for b in blocks]) if blocks else np.zeros(0, dtype=np.int64)
+        flat_offsets = np.concatenate([np.zeros(1, dtype=np.int64), np.cumsum(sizes)])
+    cdef const int64_t[::1] v = np.ascontiguousarray(flat_vertices, dtype=np.int64)
+    cdef const int64_t[::1] o = np.ascontiguousarray(flat_offsets, dtype=np.int64)
+    cdef Py_ssize_t i
+    vertices.reserve(v.shape[0])
+    for i in range(v.shape[0]):
+        vertices.push_back(v[i])
+    offsets.reserve(o.shape[0])
+    for i in range(o.shape[0]):
+        offsets.push_back(o[i])
+
+cdef dict _profile_dict(Profile& profile):
+    """The phases of profile, as {name: (calls, seconds)}."""
+    cdef int p
+    phases = {}
+    for p in range(ProfilePhases):
+        phases[Profile.name(<ProfilePhase> p).decode('utf-8')] = (profile.calls(<ProfilePhase> p), profile.seconds(<ProfilePhase> p))
+    return phases
+
+def ls_vineyards(filtrations, complex, discard, rebuild_threshold = float("inf"), segments = 1, homology = -1, epsilon = 0, flat = False, stats = False, profile = False):
+    """Computes the vineyard of the lower-star filtrations (one list of vertex values per frame) of complex.
+    The complex is either the path of a file (with one simplex, its vertices, per line, or written by save_binary_complex()), or it is given in memory,
+    either as a list of per-dimension arrays (the simplices of dimension d are the rows of an array with d + 1 columns),
+    or as a pair of arrays (vertices, offsets), where simplex i has the vertices vertices[offsets[i]:offsets[i+1]].
+    Returns, for every dimension, the list of its vines, each a list of [birth, death, time] knees.
+    With flat, returns the arrays (knees, offsets, dimensions) instead, which view the C++ results without a copy:
+    knees has shape (k, 3), the knees of vine v are knees[offsets[v]:offsets[v+1]], and dimensions[v] is its dimension.
+    With filtrations None, the frames are those stored in the binary complex.
+    With segments > 1, the frames are split into that many segments, computed in parallel and stitched together. The diagrams
+    are the same, but the vines may not be: where two segments meet, pairs with tied values are continued by value.
+    With stats, returns (vineyard, stats) instead, where the dict stats counts the work done: transpositions (in all, by case, and
+    those that switched the pairing), chain additions, the longest cycle and trail, kinetic events, vertex transpositions, and knees recorded.
+    With profile, the result also ends with a dict of the phases of the computation (parse, sort, boundaries, attachment, reduction, sweep,
+    extraction, and conversion to and from Python), as {phase: (calls, seconds)}; the seconds are wall-clock time, summed over the threads."""
+    cdef FlatVineyard result
+    cdef vector[vector[vector[double]]] nested
+    cdef vector[vector[double]] values
+    cdef VineyardStats counts
+    cdef Profile phases
+    cdef ProfileActivation* activation = NULL
+    cdef vector[int64_t] vertices, offsets
+    start = time.perf_counter()
+    if isinstance(complex, str):
+        complex = complex.encode('utf-8')
+    if filtrations is not None:
+        values = filtrations
+    if not isinstance(complex, bytes):
+        _complex_vectors(complex, vertices, offsets)
+    phases.add(ProfileConversion, time.perf_counter() - start)
+
+    if profile:
+        activation = new ProfileActivation(phases)
+    try:
+        if filtrations is None:
+            if not flat:
+                nested = binary_vineyards(complex, discard, 1, rebuild_threshold, segments, homology, epsilon, &counts)
+            else:
+                result = flat_binary_vineyards(complex, discard, rebuild_threshold, segments, homology, epsilon)
+        elif isinstance(complex, bytes):
+            if not flat:
+                nested = vineyards(values, <string> complex, discard, 1, rebuild_threshold, segments, homology, epsilon, &counts)
+            else:
+                result = flat_vineyards(values, <string> complex, discard, rebuild_threshold, segments, homology, epsilon)
+        else:
+            if not flat:
+                nested = vineyards(values, vertices, offsets, discard, 1, rebuild_threshold, segments, homology, epsilon, &counts)
+            else:
+                result = flat_vineyards(values, vertices, offsets, discard, rebuild_threshold, segments, homology, epsilon)
+    finally:
+        del activation
+
+    start = time.perf_counter()
+    if flat:
+        vineyard = (np.asarray(_knee_array(result.knees)), np.asarray(_index_array(result.offsets)), np.asarray(_index_array(result.dimensions)))
+        counts = result.stats
+    else:
+        vineyard = nested
+    phases.add(ProfileConversion, time.perf_counter() - start)
+
+    output = (vineyard,)
+    if stats:
+        output += (counts,)
+    if profile:
+        output += (_profile_dict(phases),)
+    return output if len(output) > 1 else vineyard
+
+def save_binary_complex(filename, complex, filtrations = None):
+    """Writes complex (a path or arrays, as in ls_vineyards()), and the frames of filtrations if any, to filename in the binary format
+    that ls_vineyards() memory-maps: reusing it skips parsing the complex and looking up the faces of its simplices."""
+    cdef vector[int64_t] vertices, offsets
+    cdef vector[vector[double]] values
+    if filtrations is not None:
+        values = filtrations
+    if isinstance(filename, str):
+        filename = filename.encode('utf-8')
+    if isinstance(complex, str):
+        complex = complex.encode('utf-8')
+    if isinstance(complex, bytes):
+        write_binary_complex(filename, complex, values)
+    else:
+        _complex_vectors(complex, vertices, offsets)
+        write_binary_complex(filename, vertices, offsets, values)
+
+def save_ls_checkpoint(filename, filtration, complex, homology = -1, epsilon = 0):
+    """Writes to filename a checkpoint of the vineyard of complex (a path or arrays, as in ls_vineyards()) at the lower-star filtration
+    filtration (one value per vertex), i.e., of its initial reduction, which dominates the setup of large complexes.
+    ls_vineyards_from_checkpoint() then starts from it, e.g., for several families of lines that share their first one."""
+    cdef vector[int64_t] vertices, offsets
+    cdef vector[double] values = filtration
+    if isinstance(filename, str):
+        filename = filename.encode('utf-8')
+    if isinstance(complex, str):
+        complex = complex.encode('utf-8')
+    if isinstance(complex, bytes):
+        write_checkpoint(filename, values, <string> complex, homology, epsilon)
+    else:
+        _complex_vectors(complex, vertices, offsets)
+        write_checkpoint(filename, values, vertices, offsets, homology, epsilon)
+
+def ls_vineyards_from_checkpoint(filtrations, checkpoint, discard, rebuild_threshold = float("inf"), stats = False):
+    """ls_vineyards() of filtrations, starting from the checkpoint written by save_ls_checkpoint() instead of from a reduction:
+    filtrations[0] must be the filtration it was written at (a mismatch raises an error). The complex, homology and epsilon
+    are those of the checkpoint. With stats, returns (vineyard, stats) as ls_vineyards() does."""
+    cdef VineyardStats counts
+    if isinstance(checkpoint, str):
+        checkpoint = checkpoint.encode('utf-8')
+    vineyard = vineyards_from_checkpoint(filtrations, checkpoint, discard, 1, rebuild_threshold, &counts)
+    if stats:
+        return vineyard, counts
+    return vineyard
+
+def batch_ls_vineyards(jobs, discard, rebuild_threshold = float("inf"), threads = 0, homology = -1, epsilon = 0, stats = False, profile = False):
+    """Computes ls_vineyards() for every (complex, filtrations) pair in jobs, in parallel, on threads threads (0 for all the cores).
+    Each complex is a path or arrays, as in ls_vineyards().
+    With homology >= 0, only the vines of that dimension are computed (the others are left empty).
+    With epsilon > 0, the vines whose persistence never exceeds epsilon are dropped.
+    Returns, in the order of jobs, the tuples (vineyard, seconds, peak_memory), with the wall-clock time and the estimated peak memory (in bytes) of each job.
+    With stats, the tuples end with the counts of the work done by each job as well, and with profile, with its phases (see ls_vineyards());
+    the conversion of the jobs to C++ is shared, and left out of the profiles."""
+    cdef vector[string] complexes
+    cdef vector[vector[int64_t]] complex_vertices, complex_offsets
+    cdef vector[int64_t] vertices, offsets
+    cdef vector[vector[vector[double]]] filtrations = [filtration for (_, filtration) in jobs]
+    for (complex, _) in jobs:
+        if isinstance(complex, str):
+            complex = complex.encode('utf-8')
+        vertices.clear()
+        offsets.clear()
+        if isinstance(complex, bytes):
+            complexes.push_back(complex)
+        else:
+            complexes.push_back(b'')
+            _complex_vectors(complex, vertices, offsets)
+        complex_vertices.push_back(vertices)
+        complex_offsets.push_back(offsets)
+    cdef double threshold = rebuild_threshold, eps = epsilon
+    cdef int d = discard, t = threads, h = homology
+    cdef vector[VineyardResult] results
+    with nogil:
+        results = batch_vineyards(complexes, complex_vertices, complex_offsets, filtrations, d, 1, threshold, t, h, eps)
+    cdef size_t i
+    output = []
+    for i in range(results.size()):
+        start = time.perf_counter()
+        vineyard = results[i].vineyard
+        results[i].profile.add(ProfileConversion, time.perf_counter() - start)
+        output.append((vineyard, results[i].seconds, results[i].peak_memory) + ((results[i].stats,) if stats else ()) + ((_profile_dict(results[i].profile),) if profile else ()))
+    return output
+
+
+def ls_vineyards_stream(filtrations, complex, discard, diagrams = False, buffer = 0, homology = -1, epsilon = 0):
+    """Generator over the vineyard of ls_vineyards(), computed one frame at a time, so that only a bounded number of knees is held at once.
+    Yields the knees as (vine, dimension, birth, death, time), as soon as they are final (the vineyard keeps up to about buffer of them
+    before passing them on); the knees of each vine come in order of time. With diagrams, yields (time, diagram) for every frame instead,
+    where diagram[d] lists the births and deaths of dimension d, interleaved: the rows of LSVineyard.current_diagram(d), flattened.
+    The complex is a path or arrays, as in ls_vineyards().
+    The generator returns the counts of the work done (see ls_vineyards()), e.g. as the value of a yield from."""
+    cdef VineyardStream* stream
+    cdef vector[int64_t] vertices, offsets
+    if isinstance(complex, str):
+        complex = complex.encode('utf-8')
+    if isinstance(complex, bytes):
+        stream = new VineyardStream(filtrations, <string> complex, discard, 0 if diagrams else 1, buffer, homology, epsilon)
+    else:
+        _complex_vectors(complex, vertices, offsets)
+        stream = new VineyardStream(filtrations, vertices, offsets, discard, 0 if diagrams else 1, buffer, homology, epsilon)
+    cdef vector[vector[double]] knees
+    cdef vector[pair[double, vector[vector[double]]]] dgms
+    try:
+        while stream.step():
+            if diagrams:
+                stream.take_diagrams(dgms)
+                for dgm in dgms:
+                    yield dgm
+            else:
+                stream.take_knees(knees)
+                for k in knees:
+                    yield (<long> k[0], <long> k[1], k[2], k[3], k[4])
+        return stream.stats()
+    finally:
+        del stream
+
+
+cdef class LSVineyard:
+    """Vineyard of the lower-star filtrations of a complex, pushed one frame at a time, e.g., as an online system generates them.
+    The complex (a path or arrays, as in ls_vineyards()) is read once, and reduced at the first frame; every frame after that
+    extends the vines from the previous one, and the diagram and the vines so far can be read in between.
+    The same frames pushed one by one give the vineyard of ls_vineyards()."""
+    cdef LiveVineyard* live
+
+    def __cinit__(self, complex, rebuild_threshold = float("inf"), homology = -1, epsilon = 0):
+        cdef vector[int64_t] vertices, offsets
+        if isinstance(complex, str):
+            complex = complex.encode('utf-8')
+        if isinstance(complex, bytes):
+            self.live = new LiveVineyard(<string> complex, rebuild_threshold, homology, epsilon)
+        else:
+            _complex_vectors(complex, vertices, offsets)
+            self.live = new LiveVineyard(vertices, offsets, rebuild_threshold, homology, epsilon)
+
+    def __dealloc__(self):
+        del self.live
+
+    def __len__(self):
+        """The number of frames pushed so far."""
+        return self.live.size()
+
+    def push_frame(self, values):
+        """Extends the vineyard to the filtration given by values, one per vertex, at time len(self)."""
+        self.live.push_frame(values)
+
+    def current_diagram(self, dim, discard = False):
+        """The persistence diagram of dimension dim at the last frame, as an array of shape (k, 2) of births and deaths;
+        with discard, without its infinite points."""
+        return np.array(self.live.diagram(dim, discard), dtype = np.float64).reshape(-1, 2)
+
+    def vines(self, discard = False):
+        """The vines so far, as returned by ls_vineyards()."""
+        return self.live.vines(discard)
 
-def ls_vineyards(filtrations, complex, discard):
-    return vineyards(filtrations, complex, discard, 1)
+    def stats(self):
+        """The counts of the work done so far (see ls_vineyards())."""
+        return self.live.stats()
@@ -0,0 +1,117 @@
+#ifndef __LINEAR_CROSSINGS_H__
+#define __LINEAR_CROSSINGS_H__
+
+#include <vector>
+#include "linear-kernel.h"
+
+/**
+ * Computes, offline, the sequence of adjacent transpositions that <KineticSort> would perform
+ * on elements moving along linear trajectories over the time interval [0, end).
+ *
+ * Since two lines cross at most once, the pairs that swap are exactly the inversions between the
+ * order at time 0 and the order just before end. They are collected with a merge sort (each pair
+ * the merge puts in reverse order is a crossing), ordered by crossing time, and then replayed.
+ * There is no event queue to maintain: the cost is O(n log n + k log k) for k crossings.
+ *
+ * At most max_crossings are stored at a time. When there are more, replay() splits [0, end) into
+ * windows that hold at most that many each (found by repeated counting), and it enumerates each window
+ * from the order reached at its start. This keeps memory at O(n + max_crossings) for dense frames.
+ *
+ * Elements are identified by their position in the initial order. The rule for when a pair
+ * crosses mirrors <Simulator>: the later element must be decreasing relative to the earlier one,
+ * and the crossing time t must satisfy 0 <= t < end. Crossings at distinct times are performed in
+ * the same order as by the simulator. Simultaneous ones are ordered by element id, which need not
+ * match the simulator's order: with tied values, the diagrams agree but the vines may be connected
+ * differently.
+ *
+ *  \arg T      number type of the <LinearKernel>
+ *
+ *  \ingroup kinetic
+ */
+template<class T>
+class LinearCrossings
+{
+	public:
+		typedef						LinearKernel<T>								FunctionKernel;
+		typedef						typename FunctionKernel::Function			Function;
+		typedef						T											Time;
+
+		struct Crossing
+		{
+			Time					time;
+			unsigned				left, right;		// left precedes right before time
+
+									Crossing(Time t, unsigned l, unsigned r):
+										time(t), left(l), right(r)				{}
+		};
+		typedef						std::vector<Crossing>						CrossingVector;
+
+		/// \name Core Functionality
+		/// @{
+									LinearCrossings(Time end = FunctionKernel::root(1), size_t max_crossings = 1 << 22):
+										end_(end), current_(FunctionKernel::root(0)),
+										max_crossings_(max_crossings), size_(0)		{}
+
+		/// Enumerates the crossings among the trajectories te(i) of the elements in [b,e), given in their order at time 0.
+		template<class ElementIterator, class TrajectoryExtractor>
+		void						compute(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te);
+
+		/// Only counts the crossings, in O(n log n); final_position() is available afterwards, but not replay().
+		template<class ElementIterator, class TrajectoryExtractor>
+		size_t						count(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te);
+
+		/// Performs the crossings in order of time; swap(p) is called to transpose the elements at positions p and p+1.
+		template<class Swap>
+		void						replay(Swap swap)							{ replay(swap, NoGroup()); }
+		/// Same, and group(true) and group(false) are called around every group of crossings that share a time
+		/// (e.g., several lines through a common point), which together permute a contiguous run of elements.
+		template<class Swap, class Group>
+		void						replay(Swap swap, Group group);
+		/// @}
+
+		Time						current_time() const						{ return current_; }
+		const CrossingVector&		crossings() const							{ return crossings_; }
+		size_t						size() const								{ return size_; }
+
+		/// Position of (initial) element i at the end of the interval (after count(), or compute() that did not overflow)
+		unsigned					final_position(unsigned i) const			{ return final_[i]; }
+
+	private:
+		bool						cross(unsigned l, unsigned r, Time& t) const;
+		template<class ElementIterator, class TrajectoryExtractor>
+		void						prepare(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te);
+		size_t						window(Time bg, Time end, bool record, bool bounded);
+		size_t						sort(unsigned b, unsigned e);
+		template<class Swap, class Group>
+		void						perform(Swap& swap, Group& group);
+		template<class Swap>
+		void						transpose(unsigned l, unsigned r, Swap& swap);
+
+		struct						CrossingComparison;
+		struct						NoGroup										{ void operator()(bool) const {} };
+
+	private:
+		Time						end_;
+		Time						current_;
+		size_t						max_crossings_;
+
+		std::vector<Function>		trajectories_;
+		CrossingVector				crossings_;			// crossings of the current window
+		size_t						size_;				// crossings over the whole interval
+		bool						overflow_;			// compute() ran out of room; replay() goes window by window
+
+		// Merge sort of a window [window_begin_, window_end_)
+		Time						window_begin_, window_end_;
+		bool						record_, bounded_;
+		std::vector<unsigned>		sorted_;			// position -> element
+		std::vector<unsigned>		buffer_;
+		std::vector<unsigned>		final_;				// element -> position at the end of the window
+
+		// Replay
+		std::vector<unsigned>		order_;				// position -> element
+		std::vector<unsigned>		position_;			// element -> position
+};
+
+#include "linear-crossings.hpp"
+
+#endif // __LINEAR_CROSSINGS_H__
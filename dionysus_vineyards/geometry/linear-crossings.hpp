@@ -0,0 +1,230 @@
+#include <algorithm>
+
+#include "utilities/log.h"
+#include "utilities/counter.h"
+
+#ifdef COUNTERS
+static Counter*  cLinearCrossings =                 GetCounter("linear-crossings");
+static Counter*  cLinearCrossingsDetour =           GetCounter("linear-crossings/detour");
+static Counter*  cLinearCrossingsWindow =           GetCounter("linear-crossings/window");
+#endif // COUNTERS
+
+
+template<class T>
+struct LinearCrossings<T>::CrossingComparison
+{
+	// Simultaneous crossings are performed insertion-sort style: each element, in turn, is moved
+	// in front of all the preceding ones it crosses. <Simulator> takes them in the order of its
+	// event queue instead, so the resulting vines may differ (the diagrams do not).
+	bool						operator()(const Crossing& c1, const Crossing& c2) const
+	{
+		if (c1.time != c2.time)		return c1.time < c2.time;
+		if (c1.right != c2.right)	return c1.right < c2.right;
+		return c1.left > c2.left;
+	}
+};
+
+template<class T>
+template<class ElementIterator, class TrajectoryExtractor>
+void
+LinearCrossings<T>::
+compute(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te)
+{
+	prepare(b, e, te);
+	size_ = window(FunctionKernel::root(0), end_, true, true);
+	overflow_ = !record_;
+	CountBy(cLinearCrossings, size_);
+}
+
+template<class T>
+template<class ElementIterator, class TrajectoryExtractor>
+size_t
+LinearCrossings<T>::
+count(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te)
+{
+	prepare(b, e, te);
+	size_ = window(FunctionKernel::root(0), end_, false, false);
+	overflow_ = true;
+	return size_;
+}
+
+template<class T>
+template<class Swap, class Group>
+void
+LinearCrossings<T>::
+replay(Swap swap, Group group)
+{
+	if (!overflow_)
+	{
+		perform(swap, group);
+		return;
+	}
+
+	// Halve the rest of the interval until its first part fits; crossings at a single
+	// time cannot be split, so such a window is recorded regardless of its size
+	Time bg = FunctionKernel::root(0);
+	while (bg < end_)
+	{
+		Time end = end_;
+		while (window(bg, end, true, true), !record_)
+		{
+			Time mid = bg + (end - bg)/2;
+			if (!(bg < mid && mid < end))
+			{
+				window(bg, end, true, false);
+				break;
+			}
+			end = mid;
+		}
+		Count(cLinearCrossingsWindow);
+		perform(swap, group);
+		bg = end;
+	}
+}
+
+/* Private */
+template<class T>
+bool
+LinearCrossings<T>::
+cross(unsigned l, unsigned r, Time& t) const
+{
+	// Same as Simulator::add() for a linear function: r has to be decreasing relative to l,
+	// and the root must not lie in the past
+	Function f = trajectories_[r] - trajectories_[l];
+	if (!(f.a1 < 0)) return false;
+	t = -f.a0/f.a1;
+	return !(t < window_begin_) && t < window_end_;
+}
+
+template<class T>
+template<class ElementIterator, class TrajectoryExtractor>
+void
+LinearCrossings<T>::
+prepare(ElementIterator b, ElementIterator e, const TrajectoryExtractor& te)
+{
+	current_ = FunctionKernel::root(0);
+	trajectories_.clear();
+	for (ElementIterator cur = b; cur != e; ++cur)
+		trajectories_.push_back(te(cur));
+
+	unsigned n = trajectories_.size();
+	order_.resize(n);
+	position_.resize(n);
+	for (unsigned i = 0; i < n; ++i)
+		order_[i] = position_[i] = i;
+}
+
+template<class T>
+size_t
+LinearCrossings<T>::
+window(Time bg, Time end, bool record, bool bounded)
+{
+	window_begin_ = bg; window_end_ = end;
+	record_ = record; bounded_ = bounded;
+	crossings_.clear();
+
+	// Start from the order reached by the replay so far
+	unsigned n = order_.size();
+	sorted_ = order_;
+	buffer_.resize(n);
+	size_t count = sort(0, n);
+
+	final_.resize(n);
+	for (unsigned p = 0; p < n; ++p)
+		final_[sorted_[p]] = p;
+
+	if (record_)
+		std::sort(crossings_.begin(), crossings_.end(), CrossingComparison());
+	return count;
+}
+
+template<class T>
+size_t
+LinearCrossings<T>::
+sort(unsigned b, unsigned e)
+{
+	if (e - b < 2) return 0;
+
+	unsigned m = (b + e)/2;
+	size_t count = sort(b, m) + sort(m, e);
+
+	Time t;
+	if (!cross(sorted_[m-1], sorted_[m], t))		// halves are already in order
+		return count;
+
+	unsigned i = b, j = m, k = b;
+	while (i < m && j < e)
+	{
+		if (cross(sorted_[i], sorted_[j], t))
+		{
+			// sorted_[j] passes all the remaining elements of the left half
+			count += m - i;
+			if (record_ && bounded_ && crossings_.size() + (m - i) > max_crossings_)
+			{
+				record_ = false;							// keep counting, but give up the memory
+				CrossingVector().swap(crossings_);
+			}
+			for (unsigned l = i; record_ && l < m; ++l)
+			{
+				Time tl;
+				if (!cross(sorted_[l], sorted_[j], tl))		// only possible through roundoff
+					tl = t;
+				crossings_.push_back(Crossing(tl, sorted_[l], sorted_[j]));
+			}
+			buffer_[k++] = sorted_[j++];
+		} else
+			buffer_[k++] = sorted_[i++];
+	}
+	while (i < m) buffer_[k++] = sorted_[i++];
+	std::copy(buffer_.begin() + b, buffer_.begin() + k, sorted_.begin() + b);
+
+	return count;
+}
+
+template<class T>
+template<class Swap, class Group>
+void
+LinearCrossings<T>::
+perform(Swap& swap, Group& group)
+{
+	// A window never splits the crossings at a single time, so neither does a group
+	bool grouped = false;
+	for (typename CrossingVector::const_iterator cur = crossings_.begin(); cur != crossings_.end(); ++cur)
+	{
+		bool tied = cur + 1 != crossings_.end() && (cur + 1)->time == cur->time;
+		if (tied && !grouped)
+			group(grouped = true);
+		if (!(position_[cur->right] < position_[cur->left]))	// otherwise already performed on a detour
+		{
+			current_ = cur->time;
+			transpose(cur->left, cur->right, swap);
+		}
+		if (!tied && grouped)
+			group(grouped = false);
+	}
+}
+
+template<class T>
+template<class Swap>
+void
+LinearCrossings<T>::
+transpose(unsigned l, unsigned r, Swap& swap)
+{
+	// Roundoff in the crossing times may leave elements between l and r;
+	// each of them must cross one of the two, so perform those crossings first
+	while (position_[r] != position_[l] + 1)
+	{
+		Count(cLinearCrossingsDetour);
+		unsigned c = order_[position_[l] + 1];
+		if (final_[c] < final_[l])
+			transpose(l, c, swap);
+		else
+			transpose(c, r, swap);
+	}
+
+	unsigned p = position_[l];
+	swap(p);
+	std::swap(order_[p], order_[p+1]);
+	position_[order_[p]]   = p;
+	position_[order_[p+1]] = p + 1;
+}
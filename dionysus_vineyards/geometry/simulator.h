@@ -35,7 +35,7 @@ class Simulator
 
 
                                     Simulator(Time start = FunctionKernel::root(0)):
-                                        current_(start)                         {}
+                                        current_(start), count_(0)              {}
                                     ~Simulator()                                { for (Key cur = queue_.top(); cur != queue_.end(); ++cur) delete *cur; }
 
 
@@ -1,5 +1,5 @@
 from distutils.core import setup
 from distutils.extension import Extension
 from Cython.Build import cythonize
-extensions = [Extension('dionysus_vineyards', sources=['dionysus_vineyards.pyx'], language='c++')]
+extensions = [Extension('dionysus_vineyards', sources=['dionysus_vineyards.pyx'], language='c++', extra_compile_args=['-pthread'], extra_link_args=['-pthread'])]
 setup(name='dionysus_vineyards', ext_modules=cythonize(extensions), include_dirs=['.'])
@@ -0,0 +1,67 @@
+# Run with pytest, with the module built in place (python setup.py build_ext --inplace in the parent directory)
+import struct
+
+import pytest
+
+import dionysus_vineyards as dv
+
+# A path on 3 vertices, as (vertices, offsets)
+PATH_VERTICES = [0, 1, 2, 0, 1, 1, 2]
+PATH_OFFSETS  = [0, 1, 2, 3, 5, 7]
+FRAMES        = [[0, 1, 2], [2, 1, 0], [1, 2, 0]]
+
+def test_complex_arrays():
+	vineyard = dv.ls_vineyards(FRAMES, (PATH_VERTICES, PATH_OFFSETS), True)
+	assert vineyard == dv.ls_vineyards(FRAMES, [[[0], [1], [2]], [[0, 1], [1, 2]]], True)
+
+@pytest.mark.parametrize("offsets", [
+	[1, 2, 3, 5, 7],                # does not start at 0
+	[0, 1, 3, 2, 5, 7],             # decreases
+	[0, 1, 2, 3, 5],                # does not end at the number of vertices
+	[0, 1, 2, 3, 5, 8],             # past the end
+])
+def test_bad_offsets(offsets):
+	with pytest.raises(ValueError):
+		dv.ls_vineyards(FRAMES, (PATH_VERTICES, offsets), True)
+	with pytest.raises(ValueError):
+		dv.LSVineyard((PATH_VERTICES, offsets))
+
+def test_bad_vertices():
+	with pytest.raises(ValueError):
+		dv.ls_vineyards(FRAMES, ([0, 1, -2, 0, 1, 1, 2], PATH_OFFSETS), True)
+
+def test_no_frames():
+	with pytest.raises(RuntimeError):
+		dv.ls_vineyards([], (PATH_VERTICES, PATH_OFFSETS), True)
+
+def _binary_sections(data):
+	"""Byte offsets of the sections of a binary complex (see BinaryComplex): dimension_offsets, vertex_offsets, vertices, boundary_offsets, boundaries."""
+	dimension, simplices = struct.unpack_from("=IQ", data, 12)
+	pad = lambda n: (n + 7) // 8 * 8
+	sections = [40]
+	sections.append(sections[-1] + pad(8*(dimension + 2)))
+	sections.append(sections[-1] + pad(8*(simplices + 1)))
+	vertices = struct.unpack_from("=Q", data, sections[-2] + 8*simplices)[0]
+	sections.append(sections[-1] + pad(4*vertices))
+	sections.append(sections[-1] + pad(8*(simplices + 1)))
+	return sections
+
+@pytest.mark.parametrize("section, index, fmt, value", [
+	(1, 2, "=Q", 1),                # vertex offsets decrease
+	(1, 5, "=Q", 6),                # vertex offsets do not end at the number of vertices
+	(2, 4, "=I", 3),                # vertex out of range
+	(3, 4, "=Q", 1),                # boundary offsets decrease
+	(4, 3, "=I", 5),                # face out of range
+])
+def test_corrupted_binary_complex(tmp_path, section, index, fmt, value):
+	filename = str(tmp_path / "path.bin")
+	dv.save_binary_complex(filename, (PATH_VERTICES, PATH_OFFSETS), FRAMES)
+	assert dv.ls_vineyards(None, filename, True) == dv.ls_vineyards(FRAMES, (PATH_VERTICES, PATH_OFFSETS), True)
+
+	with open(filename, "rb") as f:
+		data = bytearray(f.read())
+	struct.pack_into(fmt, data, _binary_sections(data)[section] + index*struct.calcsize(fmt), value)
+	with open(filename, "wb") as f:
+		f.write(data)
+	with pytest.raises(RuntimeError, match="corrupted"):
+		dv.ls_vineyards(None, filename, True)
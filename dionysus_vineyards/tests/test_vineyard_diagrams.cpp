@@ -0,0 +1,75 @@
+// The diagrams of vineyards() (get_dgms()) against those of LiveVineyard, frame by frame, on values with many ties.
+// A knee recorded twice at the end of a frame would show up as a duplicate point.
+//
+// g++ -std=c++14 -pthread -I.. test_vineyard_diagrams.cpp -o test_vineyard_diagrams && ./test_vineyard_diagrams
+
+#include "dionysus_vineyards.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+typedef     std::vector<std::pair<double, double> >     Points;
+
+// The off-diagonal points of dgm, births and deaths interleaved, sorted
+Points points(const std::vector<double>& dgm){
+  Points result;
+  for (size_t j = 0; j < dgm.size(); j += 2)
+    if (dgm[j] != dgm[j+1])
+      result.push_back(std::make_pair(dgm[j], dgm[j+1]));
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+int main(){
+  // A triangulated n x n grid, with the values quantized to quarters, so that many of them tie
+  const int n = 5, frames = 8;
+  std::vector<boost::int64_t> vertices, offsets(1, 0);
+  for (int v = 0; v < n*n; ++v){
+    vertices.push_back(v);
+    offsets.push_back(vertices.size());
+  }
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j){
+      boost::int64_t v = i*n + j, edges[][2] = { { v, v + 1 }, { v, v + n }, { v, v + n + 1 } };
+      bool present[] = { j + 1 < n, i + 1 < n, i + 1 < n && j + 1 < n };
+      for (int e = 0; e < 3; ++e)
+        if (present[e]){
+          vertices.insert(vertices.end(), edges[e], edges[e] + 2);
+          offsets.push_back(vertices.size());
+        }
+    }
+  for (int i = 0; i + 1 < n; ++i)
+    for (int j = 0; j + 1 < n; ++j){
+      boost::int64_t v = i*n + j, triangles[][3] = { { v, v + 1, v + n + 1 }, { v, v + n, v + n + 1 } };
+      for (int t = 0; t < 2; ++t){
+        vertices.insert(vertices.end(), triangles[t], triangles[t] + 3);
+        offsets.push_back(vertices.size());
+      }
+    }
+
+  std::vector<std::vector<double> > values(frames, std::vector<double>(n*n));
+  unsigned seed = 1;
+  for (int f = 0; f < frames; ++f)
+    for (int v = 0; v < n*n; ++v){
+      seed = seed*1103515245 + 12345;
+      values[f][v] = ((seed >> 16) % 5) / 4.;
+    }
+
+  PLVineyard::LSFiltration simplices;
+  build_complex(vertices, offsets, simplices);
+  std::vector<std::vector<std::vector<double> > > dgms = vineyards(values, simplices, 0, 0);
+
+  LiveVineyard live(vertices, offsets);
+  int failures = 0;
+  for (int f = 0; f < frames; ++f){
+    live.push_frame(values[f]);
+    for (size_t d = 0; d < dgms.size(); ++d)
+      if (points(dgms[d][f]) != points(live.diagram(d, 0))){
+        std::printf("Frame %d, dimension %zu: %zu points instead of %zu\n", f, d, points(dgms[d][f]).size(), points(live.diagram(d, 0)).size());
+        ++failures;
+      }
+  }
+  if (failures) return EXIT_FAILURE;
+  std::printf("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#ifndef __BINARY_COMPLEX_H__
+#define __BINARY_COMPLEX_H__
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "utilities/types.h"
+
+/**
+ * Class: BinaryComplex
+ * A complex, and optionally the vertex values of a sequence of frames, in a versioned binary file
+ * that is memory-mapped rather than parsed. The simplices are sorted by dimension (so any skeleton
+ * is a prefix of them), and the file stores the index of every face of every simplex, so a
+ * <StaticPersistence> can be initialized without looking the faces up (see <LSVineyard>).
+ *
+ * Layout (native byte order; every section starts at a multiple of 8 bytes):
+ *   Header
+ *   uint64     dimension_offsets[dimension + 2]    simplices of dimension d are [dimension_offsets[d], dimension_offsets[d+1])
+ *   uint64     vertex_offsets[simplices + 1]       simplex i has the vertices [vertex_offsets[i], vertex_offsets[i+1])
+ *   uint32     vertices[vertex_offsets[simplices]] sorted within each simplex
+ *   uint64     boundary_offsets[simplices + 1]     simplex i has the faces [boundary_offsets[i], boundary_offsets[i+1])
+ *   uint32     boundaries[boundary_offsets[simplices]]
+ *   float64    values[frames][vertices]            value of every vertex at every frame (optional: frames may be 0)
+ *
+ * Errors (missing file, wrong magic or version, truncated file, offsets or ids inconsistent with the layout,
+ * missing faces) throw std::runtime_error; open() checks the whole file, so the accessors need not.
+ */
+class BinaryComplex
+{
+    public:
+        typedef                 boost::uint32_t                                     Id;
+        typedef                 const Id*                                           VertexIterator;
+        typedef                 const Id*                                           FaceIterator;
+
+        struct Header
+        {
+            char                magic[8];
+            boost::uint32_t     version;
+            boost::uint32_t     dimension;          // of the complex
+            boost::uint64_t     simplices;
+            boost::uint64_t     frames;
+            boost::uint64_t     vertices;           // columns of values (number of vertices of the complex, or 0 without frames)
+        };
+
+        static const boost::uint32_t    Version = 1;
+
+                                BinaryComplex(): data_(0), size_(0)                 {}
+                                BinaryComplex(const std::string& filename): data_(0), size_(0)
+                                                                                    { open(filename); }
+                                ~BinaryComplex()                                    { close(); }
+
+        void                    open(const std::string& filename);
+        void                    close();
+        bool                    is_open() const                                     { return data_ != 0; }
+
+        // Function: detect(filename)
+        // Whether filename starts with the magic of the format (as opposed to, e.g., Dionysus text format)
+        static bool             detect(const std::string& filename);
+
+        // Function: write(filename, simplices, values)
+        // Writes the simplices (each a sequence of vertices) and the frames (values[f][v] is the value of vertex v at frame f)
+        static void             write(const std::string& filename, const std::vector<std::vector<Id> >& simplices,
+                                      const std::vector<std::vector<double> >& values = std::vector<std::vector<double> >());
+
+        Dimension               dimension() const                                   { return header().dimension; }
+        size_t                  size() const                                        { return header().simplices; }
+        // Number of simplices of dimension at most d (all of them, if d is negative)
+        size_t                  skeleton_size(int d) const                          { return (d < 0 || d >= int(dimension())) ? size() : dimension_offsets_[d + 1]; }
+
+        Dimension               dimension(size_t i) const                           { return vertices_end(i) - vertices_begin(i) - 1; }
+        VertexIterator          vertices_begin(size_t i) const                      { return vertices_ + vertex_offsets_[i]; }
+        VertexIterator          vertices_end(size_t i) const                        { return vertices_ + vertex_offsets_[i + 1]; }
+        FaceIterator            boundary_begin(size_t i) const                      { return boundaries_ + boundary_offsets_[i]; }
+        FaceIterator            boundary_end(size_t i) const                        { return boundaries_ + boundary_offsets_[i + 1]; }
+
+        size_t                  frames() const                                      { return header().frames; }
+        size_t                  vertices() const                                    { return header().vertices; }
+        const double*           values(size_t frame) const                          { return values_ + frame*vertices(); }
+
+    private:
+                                BinaryComplex(const BinaryComplex&);
+        BinaryComplex&          operator=(const BinaryComplex&);
+
+        const Header&           header() const                                      { return *reinterpret_cast<const Header*>(data_); }
+
+        static const char*      magic()                                             { return "VINECPLX"; }      // 8 bytes, without the terminating zero
+
+        const char*             data_;
+        size_t                  size_;
+
+        const boost::uint64_t*  dimension_offsets_;
+        const boost::uint64_t*  vertex_offsets_;
+        const Id*               vertices_;
+        const boost::uint64_t*  boundary_offsets_;
+        const Id*               boundaries_;
+        const double*           values_;
+};
+
+#include "binary-complex.hpp"
+
+#endif // __BINARY_COMPLEX_H__
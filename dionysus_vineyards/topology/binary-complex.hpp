@@ -0,0 +1,173 @@
+#include <map>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+inline void
+BinaryComplex::
+open(const std::string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + filename);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(Header))
+    {
+        ::close(fd);
+        throw std::runtime_error(filename + " is not a binary complex");
+    }
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);                                // the mapping stays valid
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + filename);
+    data_ = static_cast<const char*>(data);
+    size_   = st.st_size;
+
+    if (std::memcmp(header().magic, magic(), sizeof(header().magic)) != 0 || header().version != Version)
+    {
+        close();
+        throw std::runtime_error(filename + " is not a binary complex (version " + std::to_string(Version) + ")");
+    }
+
+    // Sections, each checked against the size of the file before it is read
+    size_t offset = sizeof(Header);
+    const char* section;
+    #define BINARY_COMPLEX_SECTION(member, type, count)                                         \
+        section = data_ + offset;                                                               \
+        if ((count) > size_ || (offset += ((count)*sizeof(type) + 7) / 8 * 8) > size_)          \
+        { close(); throw std::runtime_error(filename + " is truncated"); }                      \
+        member = reinterpret_cast<const type*>(section);
+
+    BINARY_COMPLEX_SECTION(dimension_offsets_,  boost::uint64_t,    header().dimension + 2)
+    BINARY_COMPLEX_SECTION(vertex_offsets_,     boost::uint64_t,    header().simplices + 1)
+    BINARY_COMPLEX_SECTION(vertices_,           Id,                 vertex_offsets_[header().simplices])
+    BINARY_COMPLEX_SECTION(boundary_offsets_,   boost::uint64_t,    header().simplices + 1)
+    BINARY_COMPLEX_SECTION(boundaries_,         Id,                 boundary_offsets_[header().simplices])
+    BINARY_COMPLEX_SECTION(values_,             double,             header().frames * header().vertices)
+    #undef BINARY_COMPLEX_SECTION
+
+    // Offsets and ids, so that the accessors stay within the sections
+    #define BINARY_COMPLEX_CHECK(condition, what)                                               \
+        if (!(condition))                                                                       \
+        { close(); throw std::runtime_error(filename + " is corrupted: " + (what)); }
+
+    size_t n = header().simplices;
+    BINARY_COMPLEX_CHECK(dimension_offsets_[0] == 0 && dimension_offsets_[header().dimension + 1] == n,     "dimension offsets")
+    BINARY_COMPLEX_CHECK(vertex_offsets_[0] == 0 && boundary_offsets_[0] == 0,                             "simplex offsets")
+    for (size_t d = 0; d <= header().dimension; ++d)
+        BINARY_COMPLEX_CHECK(dimension_offsets_[d] <= dimension_offsets_[d + 1],                            "dimension offsets")
+    for (size_t d = 0; d <= header().dimension; ++d)
+        for (size_t i = dimension_offsets_[d]; i < dimension_offsets_[d + 1]; ++i)
+        {
+            BINARY_COMPLEX_CHECK(vertex_offsets_[i + 1] == vertex_offsets_[i] + d + 1,                      "vertex offsets")
+            BINARY_COMPLEX_CHECK(boundary_offsets_[i + 1] == boundary_offsets_[i] + (d > 0 ? d + 1 : 0),    "boundary offsets")
+            for (VertexIterator v = vertices_begin(i); v != vertices_end(i); ++v)
+                BINARY_COMPLEX_CHECK(!header().frames || *v < header().vertices,                            "vertex out of range")
+            for (FaceIterator f = boundary_begin(i); f != boundary_end(i); ++f)
+                BINARY_COMPLEX_CHECK(*f < i,                                                                "face out of range")
+        }
+    #undef BINARY_COMPLEX_CHECK
+}
+
+inline void
+BinaryComplex::
+close()
+{
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+    data_ = 0;
+    size_ = 0;
+}
+
+inline bool
+BinaryComplex::
+detect(const std::string& filename)
+{
+    std::ifstream   in(filename.c_str(), std::ios::binary);
+    char            m[8];
+    return in.read(m, sizeof(m)) && std::memcmp(m, magic(), sizeof(m)) == 0;
+}
+
+inline void
+BinaryComplex::
+write(const std::string& filename, const std::vector<std::vector<Id> >& simplices, const std::vector<std::vector<double> >& values)
+{
+    // Sort the vertices of each simplex, and the simplices by dimension (keeping their order otherwise)
+    std::vector<std::vector<Id> >   sorted(simplices);
+    Dimension                       dimension = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        if (sorted[i].empty())
+            throw std::runtime_error("Simplices must have at least one vertex");
+        std::sort(sorted[i].begin(), sorted[i].end());
+        dimension = std::max<Dimension>(dimension, sorted[i].size() - 1);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const std::vector<Id>& s1, const std::vector<Id>& s2) { return s1.size() < s2.size(); });
+
+    std::vector<boost::uint64_t>    dimension_offsets(dimension + 2, 0), vertex_offsets(1, 0), boundary_offsets(1, 0);
+    std::vector<Id>                 vertices, boundaries;
+    std::map<std::vector<Id>, Id>   ids;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const std::vector<Id>& s = sorted[i];
+        ++dimension_offsets[s.size()];
+        vertices.insert(vertices.end(), s.begin(), s.end());
+        vertex_offsets.push_back(vertices.size());
+
+        // Faces come before the simplex, since they have lower dimension
+        if (s.size() > 1)
+            for (size_t v = 0; v < s.size(); ++v)
+            {
+                std::vector<Id> face(s);
+                face.erase(face.begin() + v);
+                std::map<std::vector<Id>, Id>::const_iterator f = ids.find(face);
+                if (f == ids.end())
+                    throw std::runtime_error("A face of a simplex is missing from the complex");
+                boundaries.push_back(f->second);
+            }
+        boundary_offsets.push_back(boundaries.size());
+        ids[s] = i;
+    }
+    for (size_t d = 1; d < dimension_offsets.size(); ++d)
+        dimension_offsets[d] += dimension_offsets[d - 1];
+
+    Header header;
+    std::memcpy(header.magic, magic(), sizeof(header.magic));
+    header.version      = Version;
+    header.dimension    = dimension;
+    header.simplices    = sorted.size();
+    header.frames       = values.size();
+    header.vertices     = values.empty() ? 0 : values[0].size();
+    for (size_t f = 0; f < values.size(); ++f)
+        if (values[f].size() != header.vertices)
+            throw std::runtime_error("Every frame must have the same number of vertex values");
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot write " + filename);
+    static const char   padding[8] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    #define BINARY_COMPLEX_WRITE(data, bytes)                                                   \
+        out.write(reinterpret_cast<const char*>(data), (bytes));                                \
+        out.write(padding, (8 - (bytes) % 8) % 8);
+
+    BINARY_COMPLEX_WRITE(dimension_offsets.data(),  dimension_offsets.size()*sizeof(boost::uint64_t))
+    BINARY_COMPLEX_WRITE(vertex_offsets.data(),     vertex_offsets.size()*sizeof(boost::uint64_t))
+    BINARY_COMPLEX_WRITE(vertices.data(),           vertices.size()*sizeof(Id))
+    BINARY_COMPLEX_WRITE(boundary_offsets.data(),   boundary_offsets.size()*sizeof(boost::uint64_t))
+    BINARY_COMPLEX_WRITE(boundaries.data(),         boundaries.size()*sizeof(Id))
+    for (size_t f = 0; f < values.size(); ++f)
+        out.write(reinterpret_cast<const char*>(values[f].data()), values[f].size()*sizeof(double));
+    #undef BINARY_COMPLEX_WRITE
+
+    if (!out)
+        throw std::runtime_error("Cannot write " + filename);
+}
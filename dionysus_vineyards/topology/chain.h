@@ -80,6 +80,8 @@ class ChainWrapper: public Container_,
         void                                    remove(iterator i)                              { ChainRepresentation::erase(i); Size::operator--(); }
         void                                    remove(const_reference x)                       { remove(std::find(begin(), end(), x)); }
         bool                                    remove_if_contains(const_reference x);
+        template<class ConsistencyComparison>
+        bool                                    remove_if_contains(const_reference x, const ConsistencyComparison& cmp);
 
         template<class ConsistencyComparison>
         void                                    append(const_reference x, const ConsistencyComparison& cmp);
@@ -97,6 +99,12 @@ class ChainWrapper: public Container_,
 
         boost::optional<const_iterator>         contains(const_reference x) const;              ///< tests whether chain contains x
         boost::optional<iterator>               contains(const_reference x);                    ///< tests whether chain contains x
+
+        /// Same as contains(x), but uses the consistency comparison the chain is sorted by to search in O(log n) when the Container allows it
+        template<class ConsistencyComparison>
+        boost::optional<const_iterator>         contains(const_reference x, const ConsistencyComparison& cmp) const;
+        template<class ConsistencyComparison>
+        boost::optional<iterator>               contains(const_reference x, const ConsistencyComparison& cmp);
         /// @}
     
         /// \name Debugging
@@ -127,6 +127,41 @@ remove_if_contains(const_reference x)
         return false;
 }
 
+template<class C>
+template<class ConsistencyComparison>
+boost::optional<typename ChainWrapper<C>::const_iterator>
+ChainWrapper<C>::
+contains(const_reference x, const ConsistencyComparison& cmp) const
+{
+    const_iterator res = ContainerTraits<C,ConsistencyComparison>::find(begin(), end(), x, cmp);
+    return boost::make_optional(res != end(), res);
+}
+
+template<class C>
+template<class ConsistencyComparison>
+boost::optional<typename ChainWrapper<C>::iterator>
+ChainWrapper<C>::
+contains(const_reference x, const ConsistencyComparison& cmp)
+{
+    iterator res = ContainerTraits<C,ConsistencyComparison>::find(begin(), end(), x, cmp);
+    return boost::make_optional(res != end(), res);
+}
+
+template<class C>
+template<class ConsistencyComparison>
+bool
+ChainWrapper<C>::
+remove_if_contains(const_reference x, const ConsistencyComparison& cmp)
+{
+    boost::optional<iterator> i = contains(x, cmp);
+    if (i)
+    {
+        remove(*i);
+        return true;
+    } else
+        return false;
+}
+
 template<class C>
 template<class OutputMap>
 std::string
@@ -3,6 +3,7 @@
 
 #include "static-persistence.h"
 #include <utilities/types.h>
+#include <utilities/binary-stream.h>
 
 #include <boost/bind.hpp>
 #include <boost/lambda/lambda.hpp>
@@ -31,6 +32,8 @@ struct TrailData: public PairCycleData<Data_, ChainTraits_, TrailData<Data_, Cha
     void        trail_append(Index i, const Cmp& cmp)                                   { trail.append(i, cmp); }
     template<class Cmp>
     void        trail_add(const Trail& t, const Cmp& cmp)                               { trail.add(t, cmp); }
+    void        trail_clear()                                                           { trail.clear(); }
+    void        swap_trail(Trail& t)                                                    { trail.swap(t); }
 
     template<class Cmp>
     void        cycle_add(const Cycle& z, const Cmp& cmp)                               { cycle.add(z, cmp); }
@@ -39,6 +42,46 @@ struct TrailData: public PairCycleData<Data_, ChainTraits_, TrailData<Data_, Cha
     Trail                                                                               trail;
 };
 
+/**
+ * Struct: TranspositionStats
+ * Counts of the work done by a <DynamicPersistenceTrails>. Unlike the COUNTERS (global, and compiled
+ * in only on request), these are kept by every instance at all times; they cost an increment or a
+ * comparison per operation.
+ */
+struct TranspositionStats
+{
+    size_t      transpositions;                             // calls to transpose()
+    size_t      different_dimension;                        // transpositions of simplices of different dimensions, including those relocated past
+    size_t      relocations;                                // runs of such transpositions performed at once by transpose_past()
+    size_t      case12, case12s, case111, case112,          // transpositions by case (see transpose())
+                case22, case211, case212,
+                case32, case31,
+                case4;
+    size_t      switches;                                   // transpositions that switched the pairing
+    size_t      chain_additions;                            // additions of a cycle (column of R) or a trail (row of U) to another
+    size_t      max_cycle, max_trail;                       // longest cycle and trail so far
+
+                TranspositionStats():
+                    transpositions(0), different_dimension(0), relocations(0),
+                    case12(0), case12s(0), case111(0), case112(0), case22(0), case211(0), case212(0), case32(0), case31(0), case4(0),
+                    switches(0), chain_additions(0), max_cycle(0), max_trail(0)    {}
+
+    // Adds up the counts, and keeps the larger of the maxima
+    TranspositionStats&
+                operator+=(const TranspositionStats& other)
+    {
+        transpositions += other.transpositions; different_dimension += other.different_dimension; relocations += other.relocations;
+        case12 += other.case12; case12s += other.case12s; case111 += other.case111; case112 += other.case112;
+        case22 += other.case22; case211 += other.case211; case212 += other.case212;
+        case32 += other.case32; case31 += other.case31;
+        case4 += other.case4;
+        switches += other.switches; chain_additions += other.chain_additions;
+        max_cycle = std::max(max_cycle, other.max_cycle);
+        max_trail = std::max(max_trail, other.max_trail);
+        return *this;
+    }
+};
+
 /**
  * Class: DynamicPersistenceTrails
  * Derives from StaticPersistence and allows one to update persistence
@@ -95,10 +138,40 @@ class DynamicPersistenceTrails:
          */
         template<class Filtration>      DynamicPersistenceTrails(const Filtration& f);
 
+        // Constructor: DynamicPersistenceTrails(f, simplices, boundaries)
+        // Reads the boundaries off a table, see <StaticPersistence::initialize()>
+        template<class Filtration, class Boundaries>
+                                        DynamicPersistenceTrails(const Filtration& f, const std::vector<typename Filtration::Index>& simplices, const Boundaries& boundaries);
+
         template<class Filtration>
         void                            initialize(const Filtration& f)                 { Parent::initialize(f); }
 
-        void                            pair_simplices();
+        // Function: reset(const Filtration& f)
+        // Discard the decomposition: cycles become boundaries again and trails are cleared.
+        // Followed by <rearrange()> (which resets the consistent order) and <pair_simplices()>,
+        // it recomputes the decomposition from scratch without reallocating the elements.
+        template<class Filtration>
+        void                            reset(const Filtration& f);
+
+        void                            pair_simplices(bool progress = true);
+
+        // Function: pair_simplices(dimension, progress)
+        // Same pairing and cycles, computed with the clearing of <StaticPersistence::pair_simplices_clearing()>.
+        // A cleared positive column j, paired with i, has R_j = 0 without being reduced; for D = RU to hold,
+        // its column of U is e_j plus the columns of U of the other elements of R_i (since R_i is a cycle).
+        template<class DimensionFunctor>
+        void                            pair_simplices(const DimensionFunctor& dimension, bool progress = true);
+
+        // Function: compact(f)
+        // Recomputes the decomposition from scratch for the current order, f being the filtration in that order. The pairing
+        // only depends on the order, so it stays the same (and the elements keep their Data), but the cycles and the trails
+        // (R and U) lose the fill-in that the transpositions have accumulated in them.
+        template<class Filtration>
+        void                            compact(const Filtration& f);
+
+        // Function: trail_size()
+        // Total length of the trails (the nonzeros of U)
+        size_t                          trail_size() const;
 
         // Function: transpose(i)
         // Tranpose i and the next element.
@@ -109,6 +182,15 @@ class DynamicPersistenceTrails:
         template<class DimensionFunctor>
         bool                            transpose(iterator i, const DimensionFunctor& dimension)    { return transpose(i,dimension,TranspositionVisitor()); }
 
+        // Function: transpose_past(i, j)
+        // Move i in front of j (j must precede i) with the same effect as the sequence of
+        // transpositions transpose(prior(i)) until i precedes j. Runs of elements whose dimension
+        // differs from i's are jumped over with a single relocation (see <TranspositionVisitor::relocate()>),
+        // so only the transpositions within i's dimension do any work.
+        // Returns: true iff the pairing switched at least once.
+        template<class DimensionFunctor, class Visitor>
+        bool                            transpose_past(iterator i, iterator j, const DimensionFunctor& dimension, Visitor visitor = Visitor());
+
         using                           Parent::begin;
         using                           Parent::end;
         using                           Parent::iterator_to;
@@ -119,6 +201,23 @@ class DynamicPersistenceTrails:
         template<class Iter>
         void                            rearrange(Iter i);
 
+        // Function: save(out, data)
+        // Writes the decomposition (the order, the pairing, the cycles and the trails, i.e., R and U, and the stats)
+        // in native binary, the elements identified by their position in the consistent order;
+        // data(out, i) writes whatever else element i holds (its Data)
+        template<class DataWriter>
+        void                            save(std::ostream& out, const DataWriter& data) const;
+
+        // Function: load(in, data)
+        // Replaces the decomposition (and the elements) with one written by save(), without any reduction;
+        // data(in, i) reads the Data of element i, once the order, the pairing, and the chains are in place
+        template<class DataReader>
+        void                            load(std::istream& in, const DataReader& data);
+
+        // Function: stats()
+        // Counts of the transpositions and chain additions performed so far, see <TranspositionStats>
+        const TranspositionStats&       stats() const                                   { return stats_; }
+
         // Struct: TranspositionVisitor
         //
         // For example, a VineardVisitor could implement this archetype.
@@ -130,6 +229,12 @@ class DynamicPersistenceTrails:
             // that may need to be updated, but perhaps it has other uses as well.
             void                        transpose(iterator i) const                     {}
 
+            // Function: relocate(pos, i)
+            // Called by <transpose_past()> instead of a run of <transpose(i)> calls, right before
+            // `i` is moved in front of `pos`. All the elements in [pos, i) have a different dimension
+            // from `i`, so the pairing is unaffected.
+            void                        relocate(iterator pos, iterator i) const        {}
+
             // Function: switched(i, type)
             // This function is called after the transposition if the switch in pairing has occured.
             // `i` is the index of the preceding simplex after the transposition.
@@ -146,30 +251,58 @@ class DynamicPersistenceTrails:
         const Consistency&              consistent_order() const                        { return order().template get<consistency>(); }
 
         bool                            trail_remove_if_contains
-                                            (iterator i, OrderIndex j)                  { TrailRemover rm(j); order().modify(i, rm); return rm.result; }
-        void                            cycle_add(iterator i, const Cycle& z)           { order().modify(i, boost::bind(&Element::template cycle_add<ConsistencyComparison>, bl::_1, boost::ref(z), ccmp_)); }      // i->cycle_add(z, ccmp_)
-        void                            trail_add(iterator i, const Trail& t)           { order().modify(i, boost::bind(&Element::template trail_add<ConsistencyComparison>, bl::_1, boost::ref(t), ccmp_)); }      // i->trail_add(t, ccmp_)
+                                            (iterator i, OrderIndex j)                  { TrailRemover rm(j, ccmp_); order().modify(i, rm); return rm.result; }
+        void                            cycle_add(iterator i, const Cycle& z)           { order().modify(i, boost::bind(&Element::template cycle_add<ConsistencyComparison>, bl::_1, boost::ref(z), ccmp_));       // i->cycle_add(z, ccmp_)
+                                                                                          ++stats_.chain_additions; stats_.max_cycle = std::max(stats_.max_cycle, i->cycle.size()); }
+        void                            trail_add(iterator i, const Trail& t)           { order().modify(i, boost::bind(&Element::template trail_add<ConsistencyComparison>, bl::_1, boost::ref(t), ccmp_));       // i->trail_add(t, ccmp_)
+                                                                                          ++stats_.chain_additions; stats_.max_trail = std::max(stats_.max_trail, i->trail.size()); }
 
     private:
         void                            swap(iterator i, iterator j);
         void                            pairing_switch(iterator i, iterator j);
 
-        struct PairingTrailsVisitor: public Parent::PairVisitor
+        // Base is Parent::PairVisitor, or Parent::PairVisitorNoProgress to pair without a progress bar
+        template<class Base>
+        struct PairingTrailsVisitor: public Base
         {
                                         PairingTrailsVisitor(Order& order, ConsistencyComparison ccmp, unsigned size):
-                                            Parent::PairVisitor(size), order_(order), ccmp_(ccmp)   {}
+                                            Base(size), order_(order), ccmp_(ccmp)          {}
 
             void                        init(iterator i) const                          { order_.modify(i,                                  boost::bind(&Element::template trail_append<ConsistencyComparison>, bl::_1, &*i, ccmp_)); Count(cTrailLength); }        // i->trail_append(&*i, ccmp)
             void                        update(iterator j, iterator i) const            { order_.modify(order_.iterator_to(*(i->pair)),     boost::bind(&Element::template trail_append<ConsistencyComparison>, bl::_1, &*j, ccmp_)); Count(cTrailLength); }        // i->pair->trail_append(&*j, ccmp)
-            void                        finished(iterator i) const                      { Parent::PairVisitor::finished(i); }
+            void                        finished(iterator i) const                      { Base::finished(i); }
 
             Order&                      order_;
             ConsistencyComparison       ccmp_;
         };
 
+        // Also keeps the columns of U (the positions of the rows whose trails received each column,
+        // without the diagonal), to fill in those of the cleared columns
+        template<class Base>
+        struct PairingClearingTrailsVisitor: public PairingTrailsVisitor<Base>
+        {
+            typedef                     PairingTrailsVisitor<Base>                      Parent;
+            typedef                     std::vector< std::vector<unsigned> >            Columns;
+
+                                        PairingClearingTrailsVisitor(Order& order, ConsistencyComparison ccmp, unsigned size, iterator begin, Columns& columns):
+                                            Parent(order, ccmp, size), begin_(begin), columns_(columns) {}
+
+            void                        init(iterator j) const;
+            void                        update(iterator j, iterator i) const            { Parent::update(j, i); columns_[j - begin_].push_back(position(i->pair)); }
+            void                        finished(iterator j) const                      { Parent::finished(j); }
+
+            unsigned                    position(OrderIndex i) const                    { return Parent::order_.iterator_to(*i) - begin_; }
+
+            iterator                    begin_;
+            Columns&                    columns_;
+        };
+
+        void                            record_lengths();
+
         struct TrailRemover;
 
         ConsistencyComparison           ccmp_;
+        TranspositionStats              stats_;
 };
 
 /* Chains */
@@ -7,6 +7,7 @@ static rlog::RLogChannel* rlTranspositions =    DEF_CHANNEL("topology/persistenc
 #ifdef COUNTERS
 static Counter*  cTransposition =               GetCounter("persistence/transposition");
 static Counter*  cTranspositionDiffDim =        GetCounter("persistence/transposition/diffdim");
+static Counter*  cTranspositionRelocate =       GetCounter("persistence/transposition/relocate");
 static Counter*  cTranspositionCase12 =         GetCounter("persistence/transposition/case/1/2");
 static Counter*  cTranspositionCase12s =        GetCounter("persistence/transposition/case/1/2/special");
 static Counter*  cTranspositionCase112 =        GetCounter("persistence/transposition/case/1/1/2");
@@ -34,14 +35,100 @@ DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
 DynamicPersistenceTrails(const Filtration& f):
     Parent(f), ccmp_(consistent_order())
 {}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class Filtration, class Boundaries>
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+DynamicPersistenceTrails(const Filtration& f, const std::vector<typename Filtration::Index>& simplices, const Boundaries& boundaries):
+    Parent(f, simplices, boundaries), ccmp_(consistent_order())
+{}
         
 template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class Filtration>
 void
 DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
-pair_simplices()
+reset(const Filtration& f)
 { 
-    PairingTrailsVisitor visitor(order(), ccmp_, size());
-    Parent::pair_simplices(begin(), end(), true, visitor);
+    Parent::reset(f);
+    for (iterator i = begin(); i != end(); ++i)
+        order().modify(i, boost::bind(&Element::trail_clear, bl::_1));      // i->trail_clear()
+}
+        
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+pair_simplices(bool progress)
+{ 
+    if (progress)
+    {
+        PairingTrailsVisitor<typename Parent::PairVisitor>              visitor(order(), ccmp_, size());
+        Parent::pair_simplices(begin(), end(), true, visitor);
+    } else
+    {
+        PairingTrailsVisitor<typename Parent::PairVisitorNoProgress>    visitor(order(), ccmp_, size());
+        Parent::pair_simplices(begin(), end(), true, visitor);
+    }
+    record_lengths();
+}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class DimensionFunctor>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+pair_simplices(const DimensionFunctor& dimension, bool progress)
+{ 
+    typename PairingClearingTrailsVisitor<typename Parent::PairVisitor>::Columns        columns(size());
+    if (progress)
+    {
+        PairingClearingTrailsVisitor<typename Parent::PairVisitor>              visitor(order(), ccmp_, size(), begin(), columns);
+        Parent::pair_simplices_clearing(dimension, visitor);
+    } else
+    {
+        PairingClearingTrailsVisitor<typename Parent::PairVisitorNoProgress>    visitor(order(), ccmp_, size(), begin(), columns);
+        Parent::pair_simplices_clearing(dimension, visitor);
+    }
+    record_lengths();
+}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+record_lengths()
+{
+    for (iterator i = begin(); i != end(); ++i)
+    {
+        stats_.max_cycle = std::max(stats_.max_cycle, i->cycle.size());
+        stats_.max_trail = std::max(stats_.max_trail, i->trail.size());
+    }
+}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class Filtration>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+compact(const Filtration& f)
+{
+    // The reduction expects the consistent order to agree with the order, as it does after the initialization
+    std::vector< boost::reference_wrapper<const Element> >    elements;
+    for (iterator i = begin(); i != end(); ++i)
+        elements.push_back(boost::cref(*i));
+
+    reset(f);
+    rearrange(elements.begin());
+    typedef     typename Parent::template SimplexMap<Filtration>       SimplexMap;
+    SimplexMap  m = Parent::make_simplex_map(f);
+    pair_simplices(SimplexMapDimension<SimplexMap>(m), false);
+}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+size_t
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+trail_size() const
+{
+    size_t size = 0;
+    for (iterator i = begin(); i != end(); ++i)
+        size += i->trail.size();
+    return size;
 }
 
 template<class D, class CT, class OT, class E, class Cmp, class CCmp>
@@ -55,6 +142,7 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
 #endif
 
     Count(cTransposition);
+    ++stats_.transpositions;
     typedef                 typename Element::Trail::iterator           TrailIterator;
 
     visitor.transpose(i);
@@ -66,6 +154,7 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
         swap(i_prev, i);
         rLog(rlTranspositions, "Different dimension");
         Count(cTranspositionDiffDim);
+        ++stats_.different_dimension;
         return false;
     }
     
@@ -76,7 +165,9 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
 
         // Case 1
         if (trail_remove_if_contains(i_prev, index(i)))
+        {
             rLog(rlTranspositions, "Case 1, U[i,i+1] = 1");
+        }
 
         iterator k = iterator_to(i_prev->pair);
         iterator l = iterator_to(i->pair);
@@ -92,16 +183,18 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
             rLog(rlTranspositions, "Case 1.2 --- unpaired");
             rLog(rlTranspositions, "%s", outmap(i_prev).c_str());
             Count(cTranspositionCase12);
+            ++stats_.case12;
             return false;
         } else if (k == i_prev)
         {
-            if (!(l->cycle.contains(index(i_prev))))
+            if (!(l->cycle.contains(index(i_prev), ccmp_)))
             {
                 // Case 1.2
                 swap(i_prev, i);
                 rLog(rlTranspositions, "Case 1.2 --- unpaired");
                 rLog(rlTranspositions, outmap(i_prev).c_str());
                 Count(cTranspositionCase12);
+                ++stats_.case12;
                 return false;
             } else
             {
@@ -112,18 +205,21 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
                 rLog(rlTranspositions, "Case 1.2 --- unpaired (pairing switch)");
                 rLog(rlTranspositions, outmap(i_prev).c_str());
                 Count(cTranspositionCase12s);
+                ++stats_.case12s;
+                ++stats_.switches;
                 return true;
             }
         }
         
         rLog(rlTranspositions, "l cycle: %s", l->cycle.tostring(outmap).c_str());
-        if (!(l->cycle.contains(index(i_prev))))
+        if (!(l->cycle.contains(index(i_prev), ccmp_)))
         {
             // Case 1.2
             rLog(rlTranspositions, "k is in l: %d", (bool) l->trail.contains(index(k)));       // if true, a special update would be needed to maintain lazy decomposition
             swap(i_prev, i);
             rLog(rlTranspositions, "Case 1.2");
             Count(cTranspositionCase12);
+            ++stats_.case12;
             return false;
         } else
         {
@@ -136,6 +232,7 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
                 trail_add(k, l->trail);               // Add row l to k
                 rLog(rlTranspositions, "Case 1.1.1");
                 Count(cTranspositionCase111);
+                ++stats_.case111;
                 return false;
             } else
             {
@@ -147,18 +244,21 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
                 visitor.switched(i, Case112);
                 rLog(rlTranspositions, "Case 1.1.2");
                 Count(cTranspositionCase112);
+                ++stats_.case112;
+                ++stats_.switches;
                 return true;
             }
         }
     } else if (!si && !sii)
     {
         // Case 2
-        if (!(i_prev->trail.contains(index(i))))
+        if (!(i_prev->trail.contains(index(i), ccmp_)))
         {
             // Case 2.2
             swap(i_prev, i);
             rLog(rlTranspositions, "Case 2.2");
             Count(cTranspositionCase22);
+            ++stats_.case22;
             return false;
         } else
         {
@@ -177,23 +277,27 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
                 visitor.switched(i, Case212);
                 rLog(rlTranspositions, "Case 2.1.2");
                 Count(cTranspositionCase212);
+                ++stats_.case212;
+                ++stats_.switches;
                 return true;
             } 
             
             // Case 2.1.1
             rLog(rlTranspositions, "Case 2.1.1");
             Count(cTranspositionCase211);
+            ++stats_.case211;
             return false;
         }
     } else if (!si && sii)
     {
         // Case 3
-        if (!(i_prev->trail.contains(index(i))))
+        if (!(i_prev->trail.contains(index(i), ccmp_)))
         {
             // Case 3.2
             swap(i_prev, i);
             rLog(rlTranspositions, "Case 3.2");
             Count(cTranspositionCase32);
+            ++stats_.case32;
             return false;
         } else
         {
@@ -207,22 +311,59 @@ transpose(iterator i, const DimensionFunctor& dimension, Visitor visitor)
             visitor.switched(i, Case31);
             rLog(rlTranspositions, "Case 3.1");
             Count(cTranspositionCase31);
+            ++stats_.case31;
+            ++stats_.switches;
             return true;
         }
     } else if (si && !sii)
     {
         // Case 4
         if (trail_remove_if_contains(i_prev, index(i)))
+        {
             rLog(rlTranspositions, "Case 4, U[i,i+1] = 1");
+        }
         swap(i_prev, i);
         rLog(rlTranspositions, "Case 4");
         Count(cTranspositionCase4);
+        ++stats_.case4;
         return false;
     }
     
     return false; // to avoid compiler complaints; we should never reach this point
 }
 
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class DimensionFunctor, class Visitor>
+bool
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+transpose_past(iterator i, iterator j, const DimensionFunctor& dimension, Visitor visitor)
+{
+    AssertMsg(j < i, "In transpose_past(i, j), j must precede i");
+    Dimension d = dimension(i);
+
+    bool result = false;
+    while (j < i)
+    {
+        // Find the run of elements of a different dimension directly preceding i
+        iterator k = i;
+        while (j < k && dimension(boost::prior(k)) != d) --k;
+        if (k != i)
+        {
+            CountBy(cTranspositionDiffDim, i - k);
+            Count(cTranspositionRelocate);
+            stats_.different_dimension += i - k;
+            ++stats_.relocations;
+            visitor.relocate(k, i);
+            swap(k, i);                                         // i now immediately precedes k
+            rLog(rlTranspositions, "Relocated past elements of different dimension");
+        }
+
+        if (j < i)
+            result |= transpose(boost::prior(i), dimension, visitor);
+    }
+
+    return result;
+}
 
 template<class D, class CT, class OT, class E, class Cmp, class CCmp>
 template<class Iter>
@@ -243,6 +384,104 @@ rearrange(Iter i)
     }
 }
 
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class DataWriter>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+save(std::ostream& out, const DataWriter& data) const
+{
+    typedef                 boost::uint32_t                             Id;
+    const Consistency&      consistent = consistent_order();
+    OffsetMap<typename Consistency::iterator, Id>   ids(consistent.begin(), 0);
+
+    write_binary(out, boost::uint64_t(size()));
+    std::vector<Id>         order_ids;
+    for (iterator i = begin(); i != end(); ++i)
+        order_ids.push_back(ids[consistent.iterator_to(*i)]);
+    write_binary(out, order_ids);
+
+    // The chains are sorted by the consistent order, so their ids come out sorted
+    std::vector<Id>         chain;
+    for (typename Consistency::iterator ci = consistent.begin(); ci != consistent.end(); ++ci)
+    {
+        write_binary(out, ids[consistent.iterator_to(*ci->pair)]);
+
+        chain.clear();
+        BOOST_FOREACH(OrderIndex k, ci->cycle)
+            chain.push_back(ids[consistent.iterator_to(*k)]);
+        write_binary(out, chain);
+
+        chain.clear();
+        BOOST_FOREACH(OrderIndex k, ci->trail)
+            chain.push_back(ids[consistent.iterator_to(*k)]);
+        write_binary(out, chain);
+
+        data(out, iterator_to(&*ci));
+    }
+    write_binary(out, stats_);
+}
+
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class DataReader>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
+load(std::istream& in, const DataReader& data)
+{
+    typedef                 boost::uint32_t                             Id;
+
+    // Fresh elements start out in the same order in both views; the element with id k stays k-th in the consistent one
+    boost::uint64_t         n;
+    read_binary(in, n);
+    order().assign(n, Element());
+    std::vector<OrderIndex> elements;
+    for (typename Consistency::iterator ci = consistent_order().begin(); ci != consistent_order().end(); ++ci)
+        elements.push_back(&*ci);
+
+    std::vector<Id>         ids;
+    read_binary(in, ids);
+    if (ids.size() != n)
+        throw std::runtime_error("The order of the decomposition is inconsistent");
+    std::vector< boost::reference_wrapper<const Element> >    ordered;
+    BOOST_FOREACH(Id k, ids)
+    {
+        if (k >= n) throw std::runtime_error("The order of the decomposition is inconsistent");
+        ordered.push_back(boost::cref(*elements[k]));
+    }
+    order().rearrange(ordered.begin());
+
+    for (Id k = 0; k < n; ++k)
+    {
+        iterator    i = iterator_to(elements[k]);
+        Id          pair;
+        read_binary(in, pair);
+        if (pair >= n) throw std::runtime_error("The pairing of the decomposition is inconsistent");
+        set_pair(i, elements[pair]);
+
+        Cycle       z;
+        read_binary(in, ids);
+        BOOST_FOREACH(Id c, ids)
+        {
+            if (c >= n) throw std::runtime_error("A cycle of the decomposition is inconsistent");
+            z.push_back(elements[c]);
+        }
+        z.sort(ccmp_);
+        swap_cycle(i, z);
+
+        Trail       t;
+        read_binary(in, ids);
+        BOOST_FOREACH(Id c, ids)
+        {
+            if (c >= n) throw std::runtime_error("A trail of the decomposition is inconsistent");
+            t.push_back(elements[c]);
+        }
+        t.sort(ccmp_);
+        order().modify(i, boost::bind(&Element::swap_trail, bl::_1, boost::ref(t)));     // i->swap_trail(t)
+
+        data(in, i);
+    }
+    read_binary(in, stats_);
+}
+
 template<class D, class CT, class OT, class E, class Cmp, class CCmp>
 void
 DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::
@@ -283,16 +522,54 @@ template<class D, class CT, class OT, class E, class Cmp, class CCmp>
 struct DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::TrailRemover: 
     public std::unary_function<Element&, void>
 {
-                                TrailRemover(OrderIndex i):
-                                    i_(i)                                       {}
+                                TrailRemover(OrderIndex i, const ConsistencyComparison& ccmp):
+                                    i_(i), ccmp_(ccmp)                          {}
     
-    void                        operator()(Element& e)                          { result = e.trail.remove_if_contains(i_); }
+    void                        operator()(Element& e)                          { result = e.trail.remove_if_contains(i_, ccmp_); }
     
     OrderIndex                  i_;
+    const ConsistencyComparison&    ccmp_;
     bool                        result;
 };
 
 
+template<class D, class CT, class OT, class E, class Cmp, class CCmp>
+template<class Base>
+void
+DynamicPersistenceTrails<D,CT,OT,E,Cmp,CCmp>::PairingClearingTrailsVisitor<Base>::
+init(iterator j) const
+{
+    Parent::init(j);
+    if (Parent::order_.iterator_to(*(j->pair)) == j)
+        return;
+
+    // j was cleared: U_j = e_j + the sum of U_m over the elements m != j of R_i, with i = j->pair
+    std::vector<unsigned>   sum;
+    BOOST_FOREACH(OrderIndex m, Parent::order_.iterator_to(*(j->pair))->cycle)
+    {
+        unsigned p = position(m);
+        if (begin_ + p == j) continue;
+        sum.push_back(p);                                                   // columns_ leaves out the diagonal
+        sum.insert(sum.end(), columns_[p].begin(), columns_[p].end());
+    }
+    std::sort(sum.begin(), sum.end());
+
+    std::vector<unsigned>&  column = columns_[j - begin_];
+    for (size_t k = 0; k < sum.size(); )
+    {
+        size_t l = k;
+        while (l < sum.size() && sum[l] == sum[k]) ++l;
+        if ((l - k) % 2)
+        {
+            column.push_back(sum[k]);
+            Parent::order_.modify(begin_ + sum[k], boost::bind(&Element::template trail_append<ConsistencyComparison>, bl::_1, &*j, Parent::ccmp_));     // k->trail_append(&*j, ccmp)
+            Count(cTrailLength);
+        }
+        k = l;
+    }
+}
+
+
 /* Chains */
 
 template<class D, class CT, class OT, class E, class Cmp, class CCmp>
@@ -75,6 +75,7 @@ class Filtration
         void                    sort(const Comparison& cmp = Comparison())      { container_.template get<order>().sort(cmp); }
         void                    push_back(const Simplex& s)                     { container_.template get<order>().push_back(s); }
         void                    transpose(Index i)                              { container_.template get<order>().relocate(i, i+1); }
+        void                    relocate(Index pos, Index i)                    { container_.template get<order>().relocate(pos, i); }
         void                    clear()                                         { container_.template get<order>().clear(); }
         template<class Iter>
         void                    rearrange(Iter i)                               { container_.template get<order>().rearrange(i); }
@@ -0,0 +1,212 @@
+#ifndef __FLAT_ORDER_H__
+#define __FLAT_ORDER_H__
+
+#include "order.h"
+
+#include <vector>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+
+/**
+ * Class: FlatOrderIndex
+ * A permutation of the elements of a <FlatOrderContainer> stored as a pair of
+ * 32-bit arrays: position -> element and element -> position. Both arrays have
+ * one extra trailing slot for the past-the-end sentinel, so end() is an
+ * ordinary iterator. Like the random access indices of multi_index, iterators
+ * follow elements (not positions) when the order changes.
+ */
+template<class Element_>
+class FlatOrderIndex
+{
+    public:
+        typedef             Element_                                                        Element;
+        typedef             Element                                                         value_type;
+        typedef             boost::uint32_t                                                 Id;
+
+        class               iterator;
+        typedef             iterator                                                        const_iterator;
+
+                            FlatOrderIndex(): base_(0)                                      { reset(0); }
+
+        iterator            begin() const                                                   { return iterator(this, elements_[0]); }
+        iterator            end() const                                                     { return iterator(this, size()); }
+        iterator            iterator_to(const Element& e) const                             { return iterator(this, &e - base_); }
+        size_t              size() const                                                    { return elements_.size() - 1; }
+
+        // Function: relocate(pos, i)
+        // Moves i in front of pos; O(1) for the adjacent transpositions that dominate the use
+        void                relocate(iterator pos, iterator i);
+
+        // Function: rearrange(i)
+        // Sets the order to the sequence of (references to) elements starting at i
+        template<class Iter>
+        void                rearrange(Iter i);
+
+        Id                  position(Id id) const                                           { return positions_[id]; }
+        Id                  id(Id position) const                                           { return elements_[position]; }
+        const Element*      base() const                                                    { return base_; }
+
+    protected:
+        template<class E>   friend class FlatOrderContainer;
+
+        void                reset(size_t n);
+        void                set_base(const Element* base)                                   { base_ = base; }
+        const Element&      element(Id id) const                                            { return base_[id]; }
+
+    private:
+        void                set(Id position, Id id)                                         { elements_[position] = id; positions_[id] = position; }
+
+        std::vector<Id>     elements_;          // position -> element
+        std::vector<Id>     positions_;         // element -> position
+        const Element*      base_;
+};
+
+template<class Element_>
+class FlatOrderIndex<Element_>::iterator:
+    public boost::iterator_facade<iterator, const Element_, boost::random_access_traversal_tag>
+{
+    public:
+                            iterator(): index_(0), id_(0)                                   {}
+                            iterator(const FlatOrderIndex* index, Id id):
+                                index_(index), id_(id)                                      {}
+
+        Id                  id() const                                                      { return id_; }
+
+    private:
+        friend class        boost::iterator_core_access;
+
+        const Element&      dereference() const                                             { return index_->element(id_); }
+        bool                equal(const iterator& other) const                              { return id_ == other.id_; }
+        void                increment()                                                     { id_ = index_->id(index_->position(id_) + 1); }
+        void                decrement()                                                     { id_ = index_->id(index_->position(id_) - 1); }
+        void                advance(std::ptrdiff_t n)                                       { id_ = index_->id(index_->position(id_) + n); }
+        std::ptrdiff_t      distance_to(const iterator& other) const                        { return std::ptrdiff_t(index_->position(other.id_)) - std::ptrdiff_t(index_->position(id_)); }
+
+        const FlatOrderIndex*   index_;
+        Id                      id_;
+};
+
+template<class E>
+void
+FlatOrderIndex<E>::
+reset(size_t n)
+{
+    elements_.resize(n + 1);
+    positions_.resize(n + 1);
+    for (Id i = 0; i <= n; ++i)
+        set(i, i);
+}
+
+template<class E>
+void
+FlatOrderIndex<E>::
+relocate(iterator pos, iterator i)
+{
+    Id p = position(pos.id()), q = position(i.id());
+    if (p == q || p == q + 1)   return;
+
+    if (q < p)
+    {
+        std::rotate(elements_.begin() + q, elements_.begin() + q + 1, elements_.begin() + p);
+        --p;
+    } else
+    {
+        std::rotate(elements_.begin() + p, elements_.begin() + q, elements_.begin() + q + 1);
+        std::swap(p, q);
+    }
+
+    for (Id k = q; k <= p; ++k)
+        positions_[elements_[k]] = k;
+}
+
+template<class E>
+template<class Iter>
+void
+FlatOrderIndex<E>::
+rearrange(Iter i)
+{
+    for (Id k = 0; k < size(); ++k, ++i)
+    {
+        const Element& e = *i;
+        set(k, &e - base_);
+    }
+}
+
+
+/**
+ * Class: FlatOrderContainer
+ * Stores the elements contiguously, in their original order, and exposes two
+ * <FlatOrderIndex> views on them: the current order (the container itself) and
+ * the consistency order (get<consistency>()). It implements the subset of the
+ * multi_index interface used by <StaticPersistence> and <DynamicPersistenceTrails>.
+ * Elements never move in memory, so pointers to them stay valid (they serve as
+ * OrderIndex); transposition only swaps two entries of the order arrays.
+ */
+template<class Element_>
+class FlatOrderContainer: public FlatOrderIndex<Element_>
+{
+    public:
+        typedef             Element_                                                        Element;
+        typedef             FlatOrderIndex<Element>                                         Index;
+        typedef             typename Index::iterator                                        iterator;
+        typedef             typename Index::const_iterator                                  const_iterator;
+
+                            FlatOrderContainer()                                            {}
+                            FlatOrderContainer(const FlatOrderContainer& other):
+                                Index(other), elements_(other.elements_),
+                                consistency_(other.consistency_)                            { rebase(); }
+
+        void                assign(size_t n, const Element& e)                              { elements_.assign(n, e); Index::reset(n); consistency_.reset(n); rebase(); }
+
+        template<class Functor>
+        bool                modify(iterator i, Functor f)                                   { f(elements_[i.id()]); return true; }
+
+        template<class Tag>
+        Index&              get()                                                           { return view(Tag()); }
+        template<class Tag>
+        const Index&        get() const                                                     { return const_cast<FlatOrderContainer*>(this)->view(Tag()); }
+
+    private:
+        FlatOrderContainer& operator=(const FlatOrderContainer& other);
+
+        Index&              view(order)                                                     { return *this; }
+        Index&              view(consistency)                                               { return consistency_; }
+
+        void                rebase()                                                        { Index::set_base(elements_.data()); consistency_.set_base(elements_.data()); }
+
+        std::vector<Element>    elements_;
+        Index                   consistency_;
+};
+
+/**
+ * Struct: FlatOrderConsistencyContainer
+ * Drop-in replacement for <OrderConsistencyContainer> backed by <FlatOrderContainer>.
+ */
+template<class Element_ = Empty<> >
+struct FlatOrderConsistencyContainer
+{
+    typedef             Element_                                                        Element;
+    typedef             FlatOrderContainer<Element>                                     Container;
+
+    typedef             typename Container::Index                                       OrderedContainer;
+    typedef             typename Container::Index                                       ConsistentContainer;
+
+    typedef             OffsetOutputMap<Container>                                      OutputMap;
+
+    template<class U> struct rebind
+    { typedef           FlatOrderConsistencyContainer<U>                                other; };
+};
+
+// Function: element_base(cmp)
+// Start of the element storage behind a comparison; lets chains (e.g., <HybridChain>)
+// turn OrderIndices into dense ids
+template<class E, class C>
+const E*    element_base(const ElementComparison<FlatOrderContainer<E>, C>& cmp)       { return cmp.container_.base(); }
+
+template<class E, class C>
+const E*    element_base(const ElementComparison<FlatOrderIndex<E>, C>& cmp)           { return cmp.container_.base(); }
+
+
+#endif // __FLAT_ORDER_H__
@@ -0,0 +1,155 @@
+#ifndef __HYBRID_CHAIN_H__
+#define __HYBRID_CHAIN_H__
+
+#include <vector>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <utilities/containers.h>
+
+/**
+ * Class: HybridChain
+ * Chain of OrderIndices (pointers to elements) that switches between two representations.
+ * While sparse, it is a vector sorted by the consistency comparison, exactly like
+ * ChainWrapper<vector<OrderIndex> >. Once the chain is dense enough (at most Sparsity_ bits
+ * of span per element), it turns into a bitset over element ids, and addition becomes an
+ * XOR of words. It converts back when the density falls below half of the threshold.
+ *
+ * Element ids are offsets from the start of the (contiguous) element storage, which the
+ * chain learns through element_base(cmp) from the comparisons passed to its modifiers;
+ * so it requires a container with contiguous, immovable elements, e.g.,
+ * <FlatOrderConsistencyContainer>. Ids never change under transpositions, which is
+ * what makes the dense representation valid across changes in the order.
+ *
+ * Iteration over a dense chain visits the elements in id order, not in the order of any
+ * comparison; sort(cmp) is a no-op for dense chains.
+ */
+template<class OrderIndex_, unsigned Sparsity_ = 32>
+class HybridChain
+{
+    public:
+        typedef         OrderIndex_                                                 OrderIndex;
+        typedef         HybridChain                                                 Self;
+        typedef         OrderIndex                                                  value_type;
+        typedef         OrderIndex                                                  const_reference;
+        typedef         OrderIndex                                                  reference;
+
+        typedef         boost::uint64_t                                             Word;
+        typedef         std::vector<OrderIndex>                                     SparseRepresentation;
+        typedef         std::vector<Word>                                           DenseRepresentation;
+
+        class           const_iterator;
+        typedef         const_iterator                                              iterator;
+
+        static const unsigned   Sparsity = Sparsity_;
+        static const size_t     MinDenseSize = 64;                                  // smaller chains always stay sparse
+        static const unsigned   WordBits = 64;
+
+    public:
+                                HybridChain(): base_(0), offset_(0), size_(0)       {}
+
+        /// \name Whole Chain operations
+        /// @{
+        /** Add c to *this assuming both are sorted in increasing order according to cmp (if sparse). */
+        template<class ConsistencyComparison>
+        Self&                   add(const Self& c, const ConsistencyComparison& cmp);
+
+        void                    swap(HybridChain& c);
+        void                    clear();
+
+        template<class ConsistencyComparison>
+        void                    sort(const ConsistencyComparison& cmp);             ///< Sort elements to enforce consistency (sparse only)
+
+        size_t                  size() const                                        { return size_; }
+        bool                    empty() const                                       { return size_ == 0; }
+        bool                    dense() const                                       { return !words_.empty(); }
+        /// @}
+
+        /// \name Modifiers
+        /// @{
+        void                    push_back(OrderIndex x);                            ///< Internal operation, should be followed by a sort()
+        template<class ConsistencyComparison>
+        void                    append(OrderIndex x, const ConsistencyComparison& cmp);
+
+        bool                    remove_if_contains(OrderIndex x);
+        template<class ConsistencyComparison>
+        bool                    remove_if_contains(OrderIndex x, const ConsistencyComparison& cmp);
+        /// @}
+
+        /// \name Accessors
+        /// @{
+        const_iterator          begin() const;
+        const_iterator          end() const;
+
+        template<class OrderComparison>
+        OrderIndex              top(const OrderComparison& cmp) const;              ///< First element in cmp order
+
+        bool                    contains(OrderIndex x) const;
+        template<class ConsistencyComparison>
+        bool                    contains(OrderIndex x, const ConsistencyComparison& cmp) const;
+        /// @}
+
+        template<class OutputMap>
+        std::string             tostring(const OutputMap& outmap = OutputMap()) const;
+
+    private:
+        size_t                  id(OrderIndex x) const                              { return x - base_; }
+        OrderIndex              element(size_t id) const                            { return base_ + id; }
+        bool                    test(size_t id) const;
+        void                    flip(size_t id);
+
+        template<class ConsistencyComparison>
+        void                    make_dense(const ConsistencyComparison& cmp);
+        template<class ConsistencyComparison>
+        void                    make_sparse(const ConsistencyComparison& cmp);
+        template<class ConsistencyComparison>
+        void                    rebalance(const ConsistencyComparison& cmp);
+        void                    trim();
+
+        SparseRepresentation    sparse_;
+        DenseRepresentation     words_;                 // bits of ids [offset_*WordBits, (offset_ + words_.size())*WordBits)
+        OrderIndex              base_;
+        size_t                  offset_;
+        size_t                  size_;
+};
+
+template<class OI, unsigned S>
+class HybridChain<OI,S>::const_iterator:
+    public boost::iterator_facade<const_iterator, OI, boost::forward_traversal_tag, OI>
+{
+    public:
+                                const_iterator(): chain_(0), pos_(0)                {}
+                                const_iterator(const HybridChain* chain, size_t pos):
+                                    chain_(chain), pos_(pos)                        {}
+
+    private:
+        friend class            boost::iterator_core_access;
+        friend class            HybridChain;
+
+        OI                      dereference() const;
+        bool                    equal(const const_iterator& other) const            { return pos_ == other.pos_; }
+        void                    increment();
+
+        const HybridChain*      chain_;
+        size_t                  pos_;                   // index into sparse_, or bit into words_
+};
+
+/**
+ * Struct: HybridChains
+ * ChainTraits that select <HybridChain>. Sparsity_ is the threshold (in bits of span
+ * per element) below which a chain switches to the dense representation.
+ */
+template<class OrderIndex_ = int, unsigned Sparsity_ = 32>
+struct HybridChains
+{
+    typedef             OrderIndex_                                             OrderIndex;
+    typedef             HybridChain<OrderIndex, Sparsity_>                      Chain;
+
+    template<class U> struct rebind
+    { typedef           HybridChains<U, Sparsity_>                              other; };
+};
+
+#include "hybrid-chain.hpp"
+
+#endif // __HYBRID_CHAIN_H__
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <iterator>
+
+#include "utilities/log.h"
+#include "utilities/counter.h"
+
+#ifdef COUNTERS
+static Counter*  cHybridChainDense =                GetCounter("chain/hybrid/dense");          // number of conversions to the dense representation
+static Counter*  cHybridChainSparse =               GetCounter("chain/hybrid/sparse");         // number of conversions back to the sparse representation
+#endif // COUNTERS
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+typename HybridChain<OI,S>::Self&
+HybridChain<OI,S>::
+add(const Self& c, const ConsistencyCmp& cmp)
+{
+    if (!dense() && !c.dense())
+    {
+        SparseRepresentation    tmp;
+        std::set_symmetric_difference(sparse_.begin(), sparse_.end(), c.sparse_.begin(), c.sparse_.end(), std::back_inserter(tmp), cmp);
+        sparse_.swap(tmp);
+        size_ = sparse_.size();
+    } else
+    {
+        if (!dense())
+            make_dense(cmp);
+
+        if (c.dense())
+        {
+            // Align the word ranges, then XOR c's words into ours
+            size_t bg  = std::min(offset_, c.offset_);
+            size_t end = std::max(offset_ + words_.size(), c.offset_ + c.words_.size());
+            words_.insert(words_.begin(), offset_ - bg, Word(0));
+            words_.resize(end - bg, Word(0));
+            offset_ = bg;
+
+            Word*           w   = &words_[c.offset_ - bg];
+            const Word*     cw  = &c.words_[0];
+            size_t          n   = c.words_.size();
+            for (size_t k = 0; k < n; ++k)
+            {
+                size_ -= __builtin_popcountll(w[k]);
+                w[k]  ^= cw[k];
+                size_ += __builtin_popcountll(w[k]);
+            }
+        } else
+            for (typename SparseRepresentation::const_iterator cur = c.sparse_.begin(); cur != c.sparse_.end(); ++cur)
+                flip(id(*cur));
+        trim();
+    }
+
+    rebalance(cmp);
+    return *this;
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::
+swap(HybridChain& c)
+{
+    sparse_.swap(c.sparse_);
+    words_.swap(c.words_);
+    std::swap(base_,    c.base_);
+    std::swap(offset_,  c.offset_);
+    std::swap(size_,    c.size_);
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::
+clear()
+{
+    sparse_.clear();
+    words_.clear();
+    offset_ = size_ = 0;
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyComparison>
+void
+HybridChain<OI,S>::
+sort(const ConsistencyComparison& cmp)
+{
+    if (!dense())
+        std::sort(sparse_.begin(), sparse_.end(), cmp);
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::
+push_back(OrderIndex x)
+{
+    if (dense())
+    {
+        if (!test(id(x))) flip(id(x));
+    } else
+    {
+        sparse_.push_back(x);
+        ++size_;
+    }
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+void
+HybridChain<OI,S>::
+append(OrderIndex x, const ConsistencyCmp& cmp)
+{
+    if (dense())
+    {
+        if (!test(id(x))) flip(id(x));
+        return;
+    }
+
+    // Same special cases as ChainWrapper::append()
+    if (sparse_.empty() || cmp(sparse_.back(), x))
+        sparse_.push_back(x);
+    else if (cmp(x, sparse_.front()))
+        sparse_.insert(sparse_.begin(), x);
+    else
+        sparse_.insert(std::upper_bound(sparse_.begin(), sparse_.end(), x, cmp), x);
+    ++size_;
+
+    rebalance(cmp);
+}
+
+template<class OI, unsigned S>
+bool
+HybridChain<OI,S>::
+remove_if_contains(OrderIndex x)
+{
+    if (dense())
+    {
+        if (!test(id(x))) return false;
+        flip(id(x));
+        trim();
+        return true;
+    }
+
+    typename SparseRepresentation::iterator cur = std::find(sparse_.begin(), sparse_.end(), x);
+    if (cur == sparse_.end()) return false;
+    sparse_.erase(cur);
+    --size_;
+    return true;
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+bool
+HybridChain<OI,S>::
+remove_if_contains(OrderIndex x, const ConsistencyCmp& cmp)
+{
+    if (dense())
+        return remove_if_contains(x);
+
+    typename SparseRepresentation::iterator cur = ContainerTraits<SparseRepresentation, ConsistencyCmp>::find(sparse_.begin(), sparse_.end(), x, cmp);
+    if (cur == sparse_.end()) return false;
+    sparse_.erase(cur);
+    --size_;
+    return true;
+}
+
+template<class OI, unsigned S>
+typename HybridChain<OI,S>::const_iterator
+HybridChain<OI,S>::
+begin() const
+{
+    if (!dense())
+        return const_iterator(this, 0);
+
+    const_iterator  res(this, 0);
+    if (!test(offset_*WordBits))
+        res.increment();
+    return res;
+}
+
+template<class OI, unsigned S>
+typename HybridChain<OI,S>::const_iterator
+HybridChain<OI,S>::
+end() const
+{
+    return const_iterator(this, dense() ? words_.size()*WordBits : sparse_.size());
+}
+
+template<class OI, unsigned S>
+template<class OrderComparison>
+OI
+HybridChain<OI,S>::
+top(const OrderComparison& cmp) const
+{
+    AssertMsg(!empty(), "Chain must not be empty for top()");
+    return *std::min_element(begin(), end(), cmp);
+}
+
+template<class OI, unsigned S>
+bool
+HybridChain<OI,S>::
+contains(OrderIndex x) const
+{
+    if (dense())
+        return test(id(x));
+    return std::find(sparse_.begin(), sparse_.end(), x) != sparse_.end();
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+bool
+HybridChain<OI,S>::
+contains(OrderIndex x, const ConsistencyCmp& cmp) const
+{
+    if (dense())
+        return test(id(x));
+    return ContainerTraits<SparseRepresentation, ConsistencyCmp>::find(sparse_.begin(), sparse_.end(), x, cmp) != sparse_.end();
+}
+
+template<class OI, unsigned S>
+template<class OutputMap>
+std::string
+HybridChain<OI,S>::
+tostring(const OutputMap& outmap) const
+{
+    std::string str;
+    for (const_iterator cur = begin(); cur != end(); ++cur)
+    {
+        if (cur != begin()) str += ", ";
+        str += outmap(*cur);
+    }
+    return str;
+}
+
+/* Private */
+template<class OI, unsigned S>
+bool
+HybridChain<OI,S>::
+test(size_t id) const
+{
+    if (id < offset_*WordBits || id >= (offset_ + words_.size())*WordBits)
+        return false;
+    id -= offset_*WordBits;
+    return (words_[id / WordBits] >> (id % WordBits)) & 1;
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::
+flip(size_t id)
+{
+    size_t w = id / WordBits;
+    if (words_.empty())
+    {
+        offset_ = w;
+        words_.assign(1, Word(0));
+    } else if (w < offset_)
+    {
+        words_.insert(words_.begin(), offset_ - w, Word(0));
+        offset_ = w;
+    } else if (w >= offset_ + words_.size())
+        words_.resize(w - offset_ + 1, Word(0));
+
+    Word& word = words_[w - offset_];
+    Word  bit  = Word(1) << (id % WordBits);
+    if (word & bit) --size_; else ++size_;
+    word ^= bit;
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+void
+HybridChain<OI,S>::
+make_dense(const ConsistencyCmp& cmp)
+{
+    base_ = element_base(cmp);
+    if (sparse_.empty()) return;
+
+    size_t min_id = id(sparse_.front()), max_id = min_id;
+    for (typename SparseRepresentation::const_iterator cur = sparse_.begin(); cur != sparse_.end(); ++cur)
+    {
+        min_id = std::min(min_id, id(*cur));
+        max_id = std::max(max_id, id(*cur));
+    }
+
+    offset_ = min_id / WordBits;
+    words_.assign(max_id / WordBits - offset_ + 1, Word(0));
+    for (typename SparseRepresentation::const_iterator cur = sparse_.begin(); cur != sparse_.end(); ++cur)
+    {
+        size_t i = id(*cur) - offset_*WordBits;
+        words_[i / WordBits] |= Word(1) << (i % WordBits);
+    }
+    SparseRepresentation().swap(sparse_);
+    Count(cHybridChainDense);
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+void
+HybridChain<OI,S>::
+make_sparse(const ConsistencyCmp& cmp)
+{
+    SparseRepresentation    tmp(begin(), end());
+    std::sort(tmp.begin(), tmp.end(), cmp);
+    sparse_.swap(tmp);
+    DenseRepresentation().swap(words_);
+    offset_ = 0;
+    Count(cHybridChainSparse);
+}
+
+template<class OI, unsigned S>
+template<class ConsistencyCmp>
+void
+HybridChain<OI,S>::
+rebalance(const ConsistencyCmp& cmp)
+{
+    if (dense())
+    {
+        if (size_ < MinDenseSize/2 || words_.size()*WordBits > 2*Sparsity*size_)
+            make_sparse(cmp);
+    } else if (size_ >= MinDenseSize)
+    {
+        OrderIndex base = element_base(cmp);
+        size_t min_id = sparse_.front() - base, max_id = min_id;
+        for (typename SparseRepresentation::const_iterator cur = sparse_.begin(); cur != sparse_.end(); ++cur)
+        {
+            min_id = std::min<size_t>(min_id, *cur - base);
+            max_id = std::max<size_t>(max_id, *cur - base);
+        }
+        if (max_id - min_id + 1 <= Sparsity*size_)
+            make_dense(cmp);
+    }
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::
+trim()
+{
+    size_t bg = 0, end = words_.size();
+    while (bg < end && words_[bg] == 0)         ++bg;
+    while (end > bg && words_[end - 1] == 0)    --end;
+
+    if (bg == end)
+    {
+        words_.clear();                         // empty dense chain is simply an empty sparse chain
+        offset_ = 0;
+        return;
+    }
+
+    words_.erase(words_.begin() + end, words_.end());
+    words_.erase(words_.begin(), words_.begin() + bg);
+    offset_ += bg;
+}
+
+/* Iterator */
+template<class OI, unsigned S>
+OI
+HybridChain<OI,S>::const_iterator::
+dereference() const
+{
+    if (chain_->dense())
+        return chain_->element(chain_->offset_*WordBits + pos_);
+    return chain_->sparse_[pos_];
+}
+
+template<class OI, unsigned S>
+void
+HybridChain<OI,S>::const_iterator::
+increment()
+{
+    if (!chain_->dense())
+    {
+        ++pos_;
+        return;
+    }
+
+    // Find the next set bit
+    const DenseRepresentation& words = chain_->words_;
+    size_t w = (pos_ + 1) / WordBits;
+    Word   m = w < words.size() ? words[w] & (~Word(0) << ((pos_ + 1) % WordBits)) : Word(0);
+    while (!m && ++w < words.size())
+        m = words[w];
+    pos_ = (w < words.size()) ? w*WordBits + __builtin_ctzll(m) : words.size()*WordBits;
+}
@@ -17,13 +17,47 @@
 
 #include <geometry/simulator.h>
 #include <geometry/kinetic-sort.h>
+#include <geometry/linear-crossings.h>
 #include <geometry/linear-kernel.h>
 
 #include <boost/tuple/tuple.hpp>
 namespace b  = boost;
 
 
-template<class Vertex_, class VertexEvaluator_, class Simplex_ = Simplex<Vertex_>, class Filtration_ = Filtration<Simplex_> >
+/**
+ * Struct: VineyardStats
+ * Counts of the work done by an <LSVineyard>, on top of those of its persistence (see <TranspositionStats>);
+ * kept at all times, see <LSVineyard::stats()>.
+ */
+struct VineyardStats: public TranspositionStats
+{
+    size_t      frames;                                     // calls to compute_vineyard()
+    size_t      rebuilds;                                   // frames computed from scratch
+    size_t      compactions;                                // decompositions recomputed to shed the fill-in of the trails
+    size_t      kinetic_events;                             // crossings replayed, or events processed by the simulator
+    size_t      event_groups;                               // groups of simultaneous kinetic events (each records a knee per vine at most)
+    size_t      vertex_transpositions;
+    size_t      attachment_changes;
+    size_t      knees;                                      // knees recorded, see <Vineyard::knees_recorded()>
+
+                VineyardStats():
+                    frames(0), rebuilds(0), compactions(0), kinetic_events(0), event_groups(0),
+                    vertex_transpositions(0), attachment_changes(0), knees(0)  {}
+
+    VineyardStats&
+                operator+=(const VineyardStats& other)
+    {
+        TranspositionStats::operator+=(other);
+        frames += other.frames; rebuilds += other.rebuilds; compactions += other.compactions;
+        kinetic_events += other.kinetic_events; event_groups += other.event_groups;
+        vertex_transpositions += other.vertex_transpositions; attachment_changes += other.attachment_changes;
+        knees += other.knees;
+        return *this;
+    }
+};
+
+template<class Vertex_, class VertexEvaluator_, class Simplex_ = Simplex<Vertex_>, class Filtration_ = Filtration<Simplex_>,
+         class ContainerTraits_ = OrderConsistencyContainer<>, class ChainTraits_ = VectorChains<> >
 class LSVineyard
 {
     public:
@@ -39,6 +73,7 @@ class LSVineyard
 
         typedef                     LinearKernel<VertexValue>                           KineticKernel;
         typedef                     Simulator<KineticKernel>                            KineticSimulator;
+        typedef                     LinearCrossings<VertexValue>                        KineticCrossings;
         class                       KineticVertexType;
         class                       KineticVertexComparison;
         class                       TrajectoryExtractor;
@@ -51,7 +86,8 @@ class LSVineyard
             void                    set_attachment(VertexIndex v)                       { attachment = v; }
             VertexIndex             attachment;
         };
-        typedef                     DynamicPersistenceTrails<AttachmentData>            Persistence;
+        typedef                     DynamicPersistenceTrails<AttachmentData, ChainTraits_, ContainerTraits_>
+                                                                                        Persistence;
         typedef                     typename Persistence::OrderIndex                    Index;
         typedef                     typename Persistence::iterator                      iterator;
 
@@ -60,6 +96,7 @@ class LSVineyard
 
         class                       Evaluator;
         class                       StaticEvaluator;
+        template<class Clock>
         class                       KineticEvaluator;
         class                       DimensionFromIterator;
 
@@ -74,17 +111,54 @@ class LSVineyard
         typedef                     Vineyard<Index, iterator, Evaluator>                Vnrd;
 
     public:
+        // homology: only the pairs of this dimension get vines (all of them, if negative); 
+        // the filtration then needs no more than its (homology + 1)-skeleton
         template<class VertexIterator>
                                     LSVineyard(VertexIterator begin, VertexIterator end,
                                                LSFiltration& filtration,
-                                               const VertexEvaluator& veval = VertexEvaluator());
+                                               const VertexEvaluator& veval = VertexEvaluator(),
+                                               Dimension homology = -1);
+
+        // Same, with the boundaries of the simplices read off a table (e.g., <BinaryComplex>),
+        // see <StaticPersistence::initialize()>; simplices[i] is the i-th simplex of the table
+        template<class VertexIterator, class Boundaries>
+                                    LSVineyard(VertexIterator begin, VertexIterator end,
+                                               LSFiltration& filtration,
+                                               const std::vector<LSFIndex>& simplices,
+                                               const Boundaries& boundaries,
+                                               const VertexEvaluator& veval = VertexEvaluator(),
+                                               Dimension homology = -1);
+
+        // Restores an LSVineyard written by save(), without any reduction: filtration is replaced by the simplices
+        // in their saved order, and veval must give the vertex values of the last frame computed before saving
+        // (they are checked against the saved ones). Throws std::runtime_error if the checkpoint does not fit.
+                                    LSVineyard(std::istream& checkpoint,
+                                               LSFiltration& filtration,
+                                               const VertexEvaluator& veval);
                                     ~LSVineyard();
 
-        void                        compute_vineyard(const VertexEvaluator& veval);
+        // explicit_crossings: enumerate and replay the vertex crossings offline
+        // (<LinearCrossings>) instead of running a <KineticSort>
+        void                        compute_vineyard(const VertexEvaluator& veval, bool explicit_crossings = false);
+
+        // How each frame was computed: by transpositions, or by a reduction from scratch (see <set_rebuild_threshold()>)
+        enum                        FrameStrategy { Update, Rebuild };
+        const std::vector<FrameStrategy>&
+                                    strategies() const                                  { return strategies_; }
+
+        // A frame is computed from scratch, with the vines reconnected by <Vineyard::reconnect_vines()>,
+        // when its vertices cross more than threshold times per simplex (never, by default)
+        void                        set_rebuild_threshold(RealType threshold)           { rebuild_threshold_ = threshold; }
+
+        // The trails (U) fill in with the transpositions. After a frame that leaves them more than factor times as long
+        // as they were after the last reduction, the decomposition is recomputed for the current order
+        // (see <DynamicPersistenceTrails::compact()>); the pairing and the vines stay the same (never, by default)
+        void                        set_compaction_threshold(RealType factor)           { compaction_threshold_ = factor; }
         bool                        transpose_vertices(VertexIndex vi);
 
         const LSFiltration&         filtration() const                                  { return filtration_; }
         const Vnrd&                 vineyard() const                                    { return vineyard_; }
+        Vnrd&                       vineyard()                                          { return vineyard_; }
         const Persistence&          persistence() const                                 { return persistence_; }
         const VertexComparison&     vertex_comparison() const                           { return vcmp_; }
         const VertexEvaluator&      vertex_evaluator() const                            { return veval_; }
@@ -98,14 +172,34 @@ class LSVineyard
 
         Index                       index(iterator i) const                             { return persistence_.index(i); }
 
+        // Counts of the work done so far (by this instance alone; they are never reset)
+        VineyardStats               stats() const;
+
+        // Writes a checkpoint, in native binary, from which the constructor above resumes: the simplices in their current
+        // order, the vertex order and values, the decomposition (pairing, R and U), the vineyard so far, and the frame count.
+        // Taken right after construction, it caches the initial reduction; taken between frames, it lets the sweep go on later.
+        void                        save(std::ostream& checkpoint) const;
+
     public:
         // For Kinetic Sort
         void                        swap(VertexIndex a, KineticSimulator* simulator);
 
     private:
-        void                        change_evaluator(Evaluator* eval);
+        void                        initialize(Dimension homology);
+        void                        initialize_attachments();                           // orders the simplices by their attachments
+        void                        load(std::istream& checkpoint);
+        static const char*          checkpoint_magic()                                  { return "VINECKPT"; }  // 8 bytes, without the terminating zero
+        static const boost::uint32_t    CheckpointVersion = 2;
+        void                        save_attachment(std::ostream& out, iterator i) const;
+        void                        load_attachment(std::istream& in, iterator i);
+        void                        transpose_position(unsigned p)                      { transpose_vertices(vertices_.begin() + p); }
+        void                        event_group(bool begin)                             { vineyard_.defer_knees(begin); if (!begin) ++stats_.event_groups; }
+        void                        attach_simplices(const VertexLSFIndexMap& vimap);
+        void                        rebuild(const VertexEvaluator& veval);
+        void                        compact();
         void                        set_attachment(iterator i, VertexIndex vi)          { persistence_.modifier()(i, boost::bind(&AttachmentData::set_attachment, bl::_1, vi)); }
         void                        transpose_filtration(iterator i)                    { filtration_.transpose(filtration_.begin() + (i - persistence_.begin())); }
+        void                        relocate_filtration(iterator pos, iterator i)       { filtration_.relocate(filtration_.begin() + (pos - persistence_.begin()), filtration_.begin() + (i - persistence_.begin())); }
 
         bool                        verify_pairing() const;
 
@@ -126,40 +220,32 @@ class LSVineyard
         PFMap                       pfmap_;
 
         Vnrd                        vineyard_;
-        Evaluator*                  evaluator_;
+        Evaluator                   evaluator_;
         unsigned                    time_count_;
 
-#if 0
-    private:
-        // Serialization
-        friend class boost::serialization::access;
-
-        LSVineyard()                                                                    {}
+        KineticCrossings            crossings_;
+        RealType                    rebuild_threshold_;
+        RealType                    compaction_threshold_;
+        size_t                      trail_baseline_;        // total length of the trails after the last reduction
+        std::vector<FrameStrategy>  strategies_;
 
-        template<class Archive>
-        void serialize(Archive& ar, version_type )
-        {
-            ar & BOOST_SERIALIZATION_NVP(grid_stack_);
-            ar & BOOST_SERIALIZATION_NVP(vertices_);
-            ar & BOOST_SERIALIZATION_NVP(filtration_);
-        };
-#endif
+        VineyardStats               stats_;                 // the counts of LSVineyard itself; stats() adds the rest
 };
 
 //BOOST_CLASS_EXPORT(LSVineyard)
 
-template<class V, class VE, class S, class C>
+template<class V, class VE, class S, class C, class CT, class CH>
 std::ostream&
-operator<<(std::ostream& out, const typename LSVineyard<V,VE,S,C>::VertexIndex& vi)
+operator<<(std::ostream& out, const typename LSVineyard<V,VE,S,C,CT,CH>::VertexIndex& vi)
 { return out << vi->vertex(); }
 
-template<class V, class VE, class S, class C>
+template<class V, class VE, class S, class C, class CT, class CH>
 std::ostream&
-operator<<(std::ostream& out, const typename LSVineyard<V,VE,S,C>::KineticVertexType& v)
+operator<<(std::ostream& out, const typename LSVineyard<V,VE,S,C,CT,CH>::KineticVertexType& v)
 { return out << v.vertex(); }
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::KineticVertexType
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::KineticVertexType
 {
     public:
                                 KineticVertexType(const Vertex& v):
@@ -176,8 +262,8 @@ class LSVineyard<V,VE,S,C>::KineticVertexType
         LSFIndex                simplex_index_;
 };
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::TrajectoryExtractor: public std::unary_function<VertexIndex, typename KineticSimulator::Function>
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::TrajectoryExtractor: public std::unary_function<VertexIndex, typename KineticSimulator::Function>
 {
     public:
         typedef                 typename KineticSimulator::Function                         Function;
@@ -193,8 +279,8 @@ class LSVineyard<V,VE,S,C>::TrajectoryExtractor: public std::unary_function<Vert
         const VertexEvaluator&  veval0_, veval1_;
 };
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::KineticVertexComparison: public std::binary_function<const KineticVertexType&, const KineticVertexType&, bool>
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::KineticVertexComparison: public std::binary_function<const KineticVertexType&, const KineticVertexType&, bool>
 {
     public:
                                 KineticVertexComparison(const VertexComparison& vcmp):
@@ -207,17 +293,18 @@ class LSVineyard<V,VE,S,C>::KineticVertexComparison: public std::binary_function
         VertexComparison            vcmp_;
 };
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::TranspositionVisitor: public Persistence::TranspositionVisitor
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::TranspositionVisitor: public Persistence::TranspositionVisitor
 {
     public:
         typedef                 typename Persistence::TranspositionVisitor                  Parent;
-        typedef                 typename LSVineyard<V,VE,S,C>::iterator                     iterator;
-        typedef                 typename LSVineyard<V,VE,S,C>::Index                        Index;
+        typedef                 typename LSVineyard<V,VE,S,C,CT,CH>::iterator                     iterator;
+        typedef                 typename LSVineyard<V,VE,S,C,CT,CH>::Index                        Index;
 
                                 TranspositionVisitor(LSVineyard& v): lsvineyard_(v)         {}
 
         void                    transpose(iterator i)                                       { lsvineyard_.transpose_filtration(i); }
+        void                    relocate(iterator pos, iterator i)                          { lsvineyard_.relocate_filtration(pos, i); }
         void                    switched(iterator i, SwitchType type)                       { lsvineyard_.vineyard_.switched(index(i), index(boost::next(i))); }
 
     private:
@@ -226,20 +313,8 @@ class LSVineyard<V,VE,S,C>::TranspositionVisitor: public Persistence::Transposit
         LSVineyard&             lsvineyard_;
 };
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::Evaluator: public std::unary_function<Index, RealType>
-{
-    public:
-        virtual ~Evaluator() {}
-        virtual RealType        time() const                                                =0;
-        virtual RealType        operator()(Index i) const                                   =0;
-        virtual Dimension       dimension(Index i) const                                    =0;
-        virtual RealType        operator()(iterator i) const                                { return operator()(&*i); }
-        virtual Dimension       dimension(iterator i) const                                 { return dimension(&*i); }
-};
-
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::DimensionFromIterator: std::unary_function<iterator, Dimension>
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::DimensionFromIterator: std::unary_function<iterator, Dimension>
 {
     public:
                                 DimensionFromIterator(const PFMap& pfmap): pfmap_(pfmap)    {}
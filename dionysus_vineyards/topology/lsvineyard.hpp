@@ -1,4 +1,9 @@
 #include <utilities/log.h>
+#include <utilities/profile.h>
+#include <utilities/binary-stream.h>
+
+#include <cstring>
+#include <stdexcept>
 
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
@@ -20,19 +25,95 @@ static Counter*  cAttachment =                              GetCounter("lsfiltra
 #endif
 
 
-template<class V, class VE, class S, class F>
+template<class V, class VE, class S, class F, class CT, class CH>
 template<class VertexIterator>
-LSVineyard<V,VE,S,F>::
+LSVineyard<V,VE,S,F,CT,CH>::
 LSVineyard(VertexIterator begin, VertexIterator end, 
            LSFiltration& fltr,
-           const VertexEvaluator& veval):
+           const VertexEvaluator& veval,
+           Dimension homology):
     filtration_(fltr),
     vertices_(begin, end),
     persistence_(filtration_),
     veval_(veval), vcmp_(veval_), scmp_(vcmp_),
     pfmap_(persistence_.make_simplex_map(filtration_)),
-    time_count_(0)
+    evaluator_(*this),
+    time_count_(0),
+    rebuild_threshold_(Infinity),
+    compaction_threshold_(Infinity),
+    trail_baseline_(0)
 {
+    initialize(homology);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+template<class VertexIterator, class Boundaries>
+LSVineyard<V,VE,S,F,CT,CH>::
+LSVineyard(VertexIterator begin, VertexIterator end, 
+           LSFiltration& fltr,
+           const std::vector<LSFIndex>& simplices,
+           const Boundaries& boundaries,
+           const VertexEvaluator& veval,
+           Dimension homology):
+    filtration_(fltr),
+    vertices_(begin, end),
+    persistence_(filtration_, simplices, boundaries),
+    veval_(veval), vcmp_(veval_), scmp_(vcmp_),
+    pfmap_(persistence_.make_simplex_map(filtration_)),
+    evaluator_(*this),
+    time_count_(0),
+    rebuild_threshold_(Infinity),
+    compaction_threshold_(Infinity),
+    trail_baseline_(0)
+{
+    initialize(homology);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+LSVineyard<V,VE,S,F,CT,CH>::
+LSVineyard(std::istream& checkpoint,
+           LSFiltration& fltr,
+           const VertexEvaluator& veval):
+    filtration_(fltr),
+    veval_(veval), vcmp_(veval_), scmp_(vcmp_),
+    pfmap_(persistence_.make_simplex_map(filtration_)),
+    evaluator_(*this),
+    time_count_(0),
+    rebuild_threshold_(Infinity),
+    compaction_threshold_(Infinity),
+    trail_baseline_(0)
+{
+    load(checkpoint);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+initialize(Dimension homology)
+{
+    initialize_attachments();
+
+    // Pair simplices
+    rLog(rlLSVineyardDebug, "Initializing LSVineyard");
+    {
+        Profile::Scope scope(Profile::Reduction);
+        persistence_.pair_simplices(DimensionFromIterator(pfmap_), false);
+    }
+    trail_baseline_ = persistence_.trail_size();
+    rLog(rlLSVineyardDebug, "Simplices paired");
+
+    evaluator_.set_static(time_count_);
+    vineyard_.set_evaluator(&evaluator_);
+    vineyard_.set_dimension(homology);
+    vineyard_.start_vines(persistence_.begin(), persistence_.end());
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+initialize_attachments()
+{
+    Profile::Scope scope(Profile::Attachment);
     vertices_.sort(KineticVertexComparison(vcmp_));     // sort vertices w.r.t. vcmp_
 #if LOGGING    
     rLog(rlLSVineyardDebug, "Vertex order:");
@@ -62,10 +143,25 @@ LSVineyard(VertexIterator begin, VertexIterator end,
         rLog(rlLSVineyardDebug, "%s attached to %d", tostring(*i).c_str(), vi->vertex());
     }
 
+    attach_simplices(vimap);
+
+#if LOGGING
+    rLog(rlLSVineyardDebug, "Simplices:");
+    for(iterator i = persistence().begin(); i != persistence().end(); ++i)
+        rLog(rlLSVineyardDebug, "  %s attached to %d", tostring(pfmap(i)).c_str(), i->attachment->vertex());
+#endif
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+attach_simplices(const VertexLSFIndexMap& vimap)
+{
     // Assign attachments for all the simplices
-    VertexAttachmentComparison  vacmp(vimap, *this);
+    OffsetMap<LSFIndex, iterator>   fpmap(filtration().begin(), persistence().begin());
+    VertexAttachmentComparison      vacmp(vimap, *this);
     for (LSFIndex i = filtration().begin(); i != filtration().end(); ++i)
-        set_attachment(fpmap[i], fpmap[vimap[*std::max_element(i->vertices().begin(), i->vertices().end(), vacmp)]]->attachment);
+        set_attachment(fpmap[i], fpmap[vimap.find(*std::max_element(i->vertices().begin(), i->vertices().end(), vacmp))->second]->attachment);
 
     // Order filtration_ and persistence_ based on attachment
     rLog(rlLSVineyardDebug, "Ordering the simplices");
@@ -84,65 +180,127 @@ LSVineyard(VertexIterator begin, VertexIterator end,
     std::vector< b::reference_wrapper<const typename Persistence::Element> >    pev; 
     BOOST_FOREACH(const SimplexPersistenceElementTuple& t, fporder)   pev.push_back(b::get<1>(t));
     persistence_.rearrange(pev.begin());
-
-#if LOGGING
-    rLog(rlLSVineyardDebug, "Simplices:");
-    for(iterator i = persistence().begin(); i != persistence().end(); ++i)
-        rLog(rlLSVineyardDebug, "  %s attached to %d", tostring(pfmap(i)).c_str(), i->attachment->vertex());
-#endif
-
-    // Pair simplices
-    rLog(rlLSVineyardDebug, "Initializing LSVineyard");
-    persistence_.pair_simplices();
-    rLog(rlLSVineyardDebug, "Simplices paired");
-
-    evaluator_ = new StaticEvaluator(*this, time_count_);
-    vineyard_.set_evaluator(evaluator_);
-    vineyard_.start_vines(persistence_.begin(), persistence_.end());
 }
 
-template<class V, class VE, class S, class F>
-LSVineyard<V,VE,S,F>::
+template<class V, class VE, class S, class F, class CT, class CH>
+LSVineyard<V,VE,S,F,CT,CH>::
 ~LSVineyard()
 {
-    delete evaluator_;
 }
 
-template<class V, class VE, class S, class F_>
+template<class V, class VE, class S, class F_, class CT, class CH>
 void                    
-LSVineyard<V,VE,S,F_>::
-compute_vineyard(const VertexEvaluator& veval)
+LSVineyard<V,VE,S,F_,CT,CH>::
+compute_vineyard(const VertexEvaluator& veval, bool explicit_crossings)
 {
     typedef     KineticSort<VertexIndex, TrajectoryExtractor, KineticSimulator>       KineticSortDS;
+    Profile::Scope scope(Profile::Sweep);
     
     // Setup the (linear) trajectories
     rLog(rlLSVineyard, "Setting up trajectories");
-    KineticSimulator    simulator;
     TrajectoryExtractor traj(veval_, veval);
     
-    KineticSortDS       sort(vertices_.begin(), vertices_.end(), 
-                             boost::bind(&LSVineyard::swap, this, bl::_1, bl::_2),
-                             &simulator, traj);
-    
-    // Process all the events (compute the vineyard in the process)
-    change_evaluator(new KineticEvaluator(*this, simulator, time_count_, traj));
-    while (!simulator.reached_infinity() && simulator.next_event_time() < 1)
+    // Past the threshold, the transpositions would cost more than a fresh reduction
+    FrameStrategy       strategy = Update;
+    if (rebuild_threshold_ != Infinity &&
+        crossings_.count(vertices_.begin(), vertices_.end(), traj) > rebuild_threshold_ * persistence_.size())
+    {
+        rebuild(veval);
+        strategy = Rebuild;
+        ++stats_.rebuilds;
+    } else if (explicit_crossings)
+    {
+        // Process all the crossings in order of time; those at a common time record their knees together
+        crossings_.compute(vertices_.begin(), vertices_.end(), traj);
+        evaluator_.set_kinetic(crossings_, time_count_, traj);
+        crossings_.replay(boost::bind(&LSVineyard::transpose_position, this, bl::_1),
+                          boost::bind(&LSVineyard::event_group, this, bl::_1));
+        stats_.kinetic_events += crossings_.size();
+        rLog(rlLSVineyard, "Processed %d crossings", crossings_.size());
+    } else
     {
-        rLog(rlLSVineyardDebug, "Next event time: %f", simulator.next_event_time());
-        simulator.process();
-        rLog(rlLSVineyardDebug, "Processed event");
+        KineticSimulator    simulator;
+        KineticSortDS       sort(vertices_.begin(), vertices_.end(), 
+                                 boost::bind(&LSVineyard::swap, this, bl::_1, bl::_2),
+                                 &simulator, traj);
+        
+        // Process all the events (compute the vineyard in the process); the events that follow
+        // one at the same time (which the queue only reveals then) record their knees together
+        evaluator_.set_kinetic(simulator, time_count_, traj);
+        bool grouped = false;
+        while (!simulator.reached_infinity() && simulator.next_event_time() < 1)
+        {
+            rLog(rlLSVineyardDebug, "Next event time: %f", simulator.next_event_time());
+            simulator.process();
+            bool tied = !simulator.reached_infinity() && simulator.next_event_time() == simulator.current_time();
+            if (tied != grouped)
+                event_group(grouped = tied);
+            rLog(rlLSVineyardDebug, "Processed event");
+        }
+        if (grouped)
+            event_group(false);
+        stats_.kinetic_events += simulator.event_count();
+        rLog(rlLSVineyard, "Processed %d events", simulator.event_count());
+        // AssertMsg(sort.audit(&simulator), "Sort audit should succeed");
     }
-    rLog(rlLSVineyard, "Processed %d events", simulator.event_count());
-    // AssertMsg(sort.audit(&simulator), "Sort audit should succeed");
+    strategies_.push_back(strategy);
+    ++stats_.frames;
+
+    if (compaction_threshold_ != Infinity && persistence_.trail_size() > compaction_threshold_ * trail_baseline_)
+        compact();
     
     veval_ = veval;
-    change_evaluator(new StaticEvaluator(*this, ++time_count_));
+    evaluator_.set_static(++time_count_);
     vineyard_.record_diagram(persistence().begin(), persistence().end());
 }
         
-template<class V, class VE, class S, class F>
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+rebuild(const VertexEvaluator& veval)
+{
+    rLog(rlLSVineyard, "Rebuilding the decomposition");
+    typename Vnrd::LivePairVector   previous;
+    vineyard_.live_pairs(persistence_.begin(), persistence_.end(), previous);
+
+    // Move the vertices into their order at the end of the frame (computed by crossings_.count())
+    std::vector<VertexIndex>        vorder(vertices_.size());
+    VertexLSFIndexMap               vimap;
+    unsigned                        p = 0;
+    for (VertexIndex vi = vertices_.begin(); vi != vertices_.end(); ++vi, ++p)
+    {
+        vorder[crossings_.final_position(p)] = vi;
+        vimap[vi->vertex()] = vi->simplex_index();
+    }
+    std::vector< b::reference_wrapper<const KineticVertexType> >      vv; 
+    BOOST_FOREACH(VertexIndex vi, vorder)                             vv.push_back(b::cref(*vi));
+    vertices_.rearrange(vv.begin());
+
+    // Recompute the attachments and the decomposition
+    persistence_.reset(filtration_);
+    attach_simplices(vimap);
+    persistence_.pair_simplices(DimensionFromIterator(pfmap_), false);
+    trail_baseline_ = persistence_.trail_size();
+
+    veval_ = veval;
+    evaluator_.set_static(time_count_ + 1);
+    vineyard_.reconnect_vines(persistence_.begin(), persistence_.end(), previous, time_count_ + .5);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+compact()
+{
+    rLog(rlLSVineyard, "Compacting the decomposition");
+    persistence_.compact(filtration_);
+    trail_baseline_ = persistence_.trail_size();
+    ++stats_.compactions;
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
 void                    
-LSVineyard<V,VE,S,F>::
+LSVineyard<V,VE,S,F,CT,CH>::
 swap(VertexIndex a, KineticSimulator* simulator)
 {
     VertexIndex b = boost::next(a);
@@ -154,24 +312,13 @@ swap(VertexIndex a, KineticSimulator* simulator)
     AssertMsg(b < a, "In swap(a,b), b must precede a after the transposition");
 }
 
-template<class V, class VE, class S, class F>
-void
-LSVineyard<V,VE,S,F>::
-change_evaluator(Evaluator* eval)
-{
-    AssertMsg(evaluator_ != 0, "change_evaluator() assumes that existing evaluator is not null");
-        
-    delete evaluator_;
-    evaluator_ = eval;
-    vineyard_.set_evaluator(evaluator_);
-}
-
-template<class V, class VE, class S, class F>
+template<class V, class VE, class S, class F, class CT, class CH>
 bool
-LSVineyard<V,VE,S,F>::
+LSVineyard<V,VE,S,F,CT,CH>::
 transpose_vertices(VertexIndex vi)
 {
     Count(cVertexTransposition);
+    ++stats_.vertex_transpositions;
     rLog(rlLSVineyard, "Transposing vertices (%d:%d, %d:%d)", vi->vertex(),             (vi -  vertices_.begin()),
                                                               b::next(vi)->vertex(),    (b::next(vi) - vertices_.begin()));
 
@@ -180,9 +327,7 @@ transpose_vertices(VertexIndex vi)
 
     OffsetMap<LSFIndex, iterator>   fpmap(filtration().begin(), persistence().begin());
     iterator i = fpmap[vi->simplex_index()];
-    iterator i_prev = b::prior(i);
     iterator i_next = fpmap[b::next(vi)->simplex_index()];
-    iterator i_next_prev = b::prior(i_next);           // transpositions are done in terms of the first index in the pair
     iterator j = b::next(i_next);
     
     VertexIndex     vi_next = b::next(vi);
@@ -190,17 +335,11 @@ transpose_vertices(VertexIndex vi)
     
     bool result = false;        // has a switch in pairing occurred
     
-    // First move the vertex --- this can be sped up if we devise special "vertex transpose" operation
+    // First move the vertex in front of the block of simplices attached to vi; only the transposition 
+    // with vi's own vertex is in the same dimension, the rest of the block is passed in bulk
     rLog(rlLSVineyardDebug, "Starting to move the vertex");
-    while (i_next_prev != i_prev)                       
-    { 
-        rLog(rlLSVineyardDebug, "  Transposing %s %s", tostring(pfmap(i_next_prev)).c_str(),
-                                                       tostring(pfmap(b::next(i_next_prev))).c_str());
-        result |= persistence_.transpose(i_next_prev, dim, visitor);
-        AssertMsg((i_next_prev  <= persistence().iterator_to(i_next_prev->pair)) == i_next_prev->sign(), "Pairing must respect order");
-        AssertMsg((i_next       <= persistence().iterator_to(i_next->pair))      == i_next->sign(),      "Pairing must respect order");
-        i_next_prev = b::prior(i_next);
-    }
+    result |= persistence_.transpose_past(i_next, i, dim, visitor);
+    AssertMsg((i_next <= persistence().iterator_to(i_next->pair)) == i_next->sign(), "Pairing must respect order");
     rLog(rlLSVineyardDebug, "Done moving the vertex");
 
     // Second, move the simplices attached to it
@@ -213,6 +352,7 @@ transpose_vertices(VertexIndex vi)
         if (pfmap(j).contains(v))       // j becomes attached to v and does not move
         {
             Count(cAttachment);
+            ++stats_.attachment_changes;
             rLog(rlLSVineyardDebug, "  Attachment changed for %s to %d", tostring(pfmap(j)).c_str(), vi->vertex());
             set_attachment(j, vi);
             AssertMsg(fpmap[vi->simplex_index()] < j, "The simplex must be attached to a preceding vertex");
@@ -220,17 +360,12 @@ transpose_vertices(VertexIndex vi)
             continue;
         }   
 
-        iterator j_prev = j; ++j;
-        while ((--j_prev)->attachment != vi_next)                // i.e., until we have reached vi_next (and the simplices that follow it) again
-        {
-            rLog(rlLSVineyardDebug, "    Moving: %s, %s", 
-                                      tostring(pfmap(j_prev)).c_str(),
-                                      tostring(pfmap(b::next(j_prev))).c_str());
-            AssertMsg(j_prev->attachment == vi, "Simplex preceding the one being moved must be attached to v");
-            result |= persistence_.transpose(j_prev, dim, visitor);
-            AssertMsg((j_prev  <= persistence().iterator_to(j_prev->pair)) == j_prev->sign(), "Pairing must respect order");
-            --j_prev;
-        }
+        // move j until we have reached vi_next (and the simplices that follow it) again, i.e., in front of i
+        iterator j_cur = j++;
+        rLog(rlLSVineyardDebug, "    Moving: %s", tostring(pfmap(j_cur)).c_str());
+        AssertMsg(b::prior(j_cur)->attachment == vi, "Simplex preceding the one being moved must be attached to v");
+        result |= persistence_.transpose_past(j_cur, i, dim, visitor);
+        AssertMsg((j_cur <= persistence().iterator_to(j_cur->pair)) == j_cur->sign(), "Pairing must respect order");
     }
     rLog(rlLSVineyard, "Done moving attached simplices");
     vertices_.relocate(vi, vi_next);                    // swap vi and vi_next
@@ -242,17 +377,167 @@ transpose_vertices(VertexIndex vi)
     return result;
 }
 
-template<class V, class VE, class S, class F>
+template<class V, class VE, class S, class F, class CT, class CH>
+VineyardStats
+LSVineyard<V,VE,S,F,CT,CH>::
+stats() const
+{
+    VineyardStats s = stats_;
+    static_cast<TranspositionStats&>(s) = persistence_.stats();
+    s.knees = vineyard_.knees_recorded();
+    return s;
+}
+
+/* Checkpoints */
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+save(std::ostream& out) const
+{
+    out.write(checkpoint_magic(), 8);
+    write_binary(out, boost::uint32_t(CheckpointVersion));
+    write_binary(out, boost::uint32_t(sizeof(Vertex)));
+    write_binary(out, boost::uint32_t(sizeof(VertexValue)));
+
+    // Simplices, in the current order: simplex i has the vertices [offsets[i], offsets[i+1])
+    std::vector<Vertex>             simplex_vertices;
+    std::vector<boost::uint64_t>    offsets(1, 0);
+    for (LSFIndex i = filtration().begin(); i != filtration().end(); ++i)
+    {
+        simplex_vertices.insert(simplex_vertices.end(), i->vertices().begin(), i->vertices().end());
+        offsets.push_back(simplex_vertices.size());
+    }
+    write_binary(out, simplex_vertices);
+    write_binary(out, offsets);
+
+    // Vertices, in their current order, with their simplices and values
+    std::vector<Vertex>             vertices;
+    std::vector<boost::uint32_t>    simplices;
+    std::vector<VertexValue>        values;
+    for (VertexIndex vi = vertices_.begin(); vi != vertices_.end(); ++vi)
+    {
+        vertices.push_back(vi->vertex());
+        simplices.push_back(vi->simplex_index() - filtration().begin());
+        values.push_back(vertex_value(vi->vertex()));
+    }
+    write_binary(out, vertices);
+    write_binary(out, simplices);
+    write_binary(out, values);
+
+    persistence_.save(out, boost::bind(&LSVineyard::save_attachment, this, bl::_1, bl::_2));
+    vineyard_.save(out);
+
+    std::vector<boost::uint8_t>     strategies(strategies_.begin(), strategies_.end());
+    write_binary(out, boost::uint64_t(time_count_));
+    write_binary(out, rebuild_threshold_);
+    write_binary(out, compaction_threshold_);
+    write_binary(out, boost::uint64_t(trail_baseline_));
+    write_binary(out, strategies);
+    write_binary(out, stats_);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+load(std::istream& in)
+{
+    char                            magic[8];
+    boost::uint32_t                 version, vertex_size, value_size;
+    if (!in.read(magic, 8) || std::memcmp(magic, checkpoint_magic(), 8) != 0)
+        throw std::runtime_error("Not a vineyard checkpoint");
+    read_binary(in, version);
+    read_binary(in, vertex_size);
+    read_binary(in, value_size);
+    if (version != CheckpointVersion || vertex_size != sizeof(Vertex) || value_size != sizeof(VertexValue))
+        throw std::runtime_error("The vineyard checkpoint was written by an incompatible version");
+
+    std::vector<Vertex>             simplex_vertices;
+    std::vector<boost::uint64_t>    offsets;
+    read_binary(in, simplex_vertices);
+    read_binary(in, offsets);
+    if (offsets.empty() || offsets.back() != simplex_vertices.size())
+        throw std::runtime_error("The simplices of the vineyard checkpoint are inconsistent");
+    filtration_.clear();
+    for (size_t i = 0; i + 1 < offsets.size(); ++i)
+        filtration_.push_back(Simplex(simplex_vertices.begin() + offsets[i], simplex_vertices.begin() + offsets[i+1]));
+
+    std::vector<Vertex>             vertices;
+    std::vector<boost::uint32_t>    simplices;
+    std::vector<VertexValue>        values;
+    read_binary(in, vertices);
+    read_binary(in, simplices);
+    read_binary(in, values);
+    if (simplices.size() != vertices.size() || values.size() != vertices.size())
+        throw std::runtime_error("The vertices of the vineyard checkpoint are inconsistent");
+    vertices_.clear();
+    for (size_t k = 0; k < vertices.size(); ++k)
+    {
+        if (simplices[k] >= filtration().size())
+            throw std::runtime_error("The vertices of the vineyard checkpoint are inconsistent");
+        if (vertex_value(vertices[k]) != values[k])
+            throw std::runtime_error("The vertex values do not match those of the vineyard checkpoint");
+        vertices_.push_back(KineticVertexType(vertices[k]));
+        vertices_.modify(vertices_.end() - 1, b::bind(&KineticVertexType::set_simplex_index, bl::_1, filtration().begin() + simplices[k]));
+    }
+
+    persistence_.load(in, boost::bind(&LSVineyard::load_attachment, this, bl::_1, bl::_2));
+    if (persistence_.size() != filtration().size())
+        throw std::runtime_error("The decomposition of the vineyard checkpoint does not match its simplices");
+    vineyard_.load(in);
+
+    boost::uint64_t                 time_count, trail_baseline;
+    std::vector<boost::uint8_t>     strategies;
+    read_binary(in, time_count);
+    read_binary(in, rebuild_threshold_);
+    read_binary(in, compaction_threshold_);
+    read_binary(in, trail_baseline);
+    read_binary(in, strategies);
+    read_binary(in, stats_);
+    time_count_ = time_count;
+    trail_baseline_ = trail_baseline;
+    strategies_.clear();
+    BOOST_FOREACH(boost::uint8_t strategy, strategies)
+        strategies_.push_back(FrameStrategy(strategy));
+
+    evaluator_.set_static(time_count_);
+    vineyard_.set_evaluator(&evaluator_);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+save_attachment(std::ostream& out, iterator i) const
+{
+    write_binary(out, boost::uint32_t(i->attachment - vertices_.begin()));
+    write_binary(out, i->vine());
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
+void
+LSVineyard<V,VE,S,F,CT,CH>::
+load_attachment(std::istream& in, iterator i)
+{
+    boost::uint32_t     attachment;
+    VineId              vine;
+    read_binary(in, attachment);
+    read_binary(in, vine);
+    if (attachment >= vertices_.size())
+        throw std::runtime_error("The attachments of the vineyard checkpoint are inconsistent");
+    set_attachment(i, vertices_.begin() + attachment);
+    i->set_vine(vine);
+}
+
+template<class V, class VE, class S, class F, class CT, class CH>
 bool
-LSVineyard<V,VE,S,F>::
+LSVineyard<V,VE,S,F,CT,CH>::
 verify_pairing() const
 {
     rLog(rlLSVineyardDebug, "Verifying pairing");
     StaticPersistence<> p(filtration());
-    p.pair_simplices(false);
+    StaticPersistence<>::SimplexMap<LSFiltration>       m = p.make_simplex_map(filtration());
+    p.pair_simplices_clearing(SimplexMapDimension<StaticPersistence<>::SimplexMap<LSFiltration> >(m), StaticPersistence<>::PairVisitorNoProgress());
     iterator                        i     = persistence().begin();
     StaticPersistence<>::iterator   ip    = p.begin();
-    StaticPersistence<>::SimplexMap<LSFiltration>       m = p.make_simplex_map(filtration());
 
     while (ip != p.end())
     {
@@ -278,56 +563,111 @@ verify_pairing() const
 
 
 /* Evaluators */
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::StaticEvaluator: public Evaluator
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::StaticEvaluator
 {
     public:
-                                StaticEvaluator(const LSVineyard& v, RealType time): 
+                                StaticEvaluator(const LSVineyard& v, RealType time = 0): 
                                     time_(time), vineyard_(v)                               {}
 
-        virtual RealType        time() const                                                { return time_; }
-        virtual RealType        operator()(Index i) const                                   { return vineyard_.simplex_value(vineyard_.pfmap(i)); }
-        virtual Dimension       dimension(Index i) const                                    { return vineyard_.pfmap(i).dimension(); }
+        void                    reset(RealType time)                                        { time_ = time; }
+        RealType                time() const                                                { return time_; }
+        // The attachment of a simplex is its maximum vertex, so its value is the simplex's (see simplex_value())
+        RealType                operator()(Index i) const                                   { return vineyard_.vertex_value(i->attachment->vertex()); }
                                 
     private:
         RealType                time_;
         const LSVineyard&       vineyard_;
 };
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::KineticEvaluator: public Evaluator
+// Clock is either the KineticSimulator or the KineticCrossings being replayed; only its current_time() is used
+template<class V, class VE, class S, class C, class CT, class CH>
+template<class Clock>
+class LSVineyard<V,VE,S,C,CT,CH>::KineticEvaluator
 {
     public:
-        typedef                 typename KineticSimulator::Time                             Time;
+        typedef                 typename Clock::Time                                        Time;
 
-                                KineticEvaluator(const LSVineyard& v, const KineticSimulator& sp, RealType time_offset, const TrajectoryExtractor& traj): 
-                                    vineyard_(v), sp_(sp), 
-                                    time_offset_(time_offset), traj_(traj)                  {}
+                                KineticEvaluator(const LSVineyard& v):
+                                    vineyard_(v), sp_(0), traj_(0), time_offset_(0)         {}
 
-        virtual RealType        time() const                                                { return time_offset_ + get_time(); }
-        virtual RealType        operator()(Index i) const                                   
+        void                    reset(const Clock& sp, RealType time_offset, const TrajectoryExtractor& traj)
+                                                                                            { sp_ = &sp; time_offset_ = time_offset; traj_ = &traj; }
+
+        RealType                time() const                                                { return time_offset_ + get_time(); }
+        RealType                operator()(Index i) const                                   
         {
             rLog(rlLSVineyard, "%s (attached to %d): %s(%f) = %f", tostring(vineyard_.pfmap(i)).c_str(),
                                                                    i->attachment->vertex(),
-                                                                   tostring(traj_(i->attachment)).c_str(),
+                                                                   tostring((*traj_)(i->attachment)).c_str(),
                                                                    get_time(),
-                                                                   traj_(i->attachment)(get_time()));
-            return traj_(i->attachment)(get_time()); 
+                                                                   (*traj_)(i->attachment)(get_time()));
+            return (*traj_)(i->attachment)(get_time()); 
         }
-        virtual Dimension       dimension(Index i) const                                    { return vineyard_.pfmap(i).dimension(); }
 
     private:
-        Time                    get_time() const                                            { return sp_.current_time(); }
+        Time                    get_time() const                                            { return sp_->current_time(); }
         
         const LSVineyard&           vineyard_;
-        const KineticSimulator&     sp_;
-        const TrajectoryExtractor&  traj_;
+        const Clock*                sp_;
+        const TrajectoryExtractor*  traj_;
         RealType                    time_offset_;
 };
 
+/**
+ * Evaluator used by the <Vineyard>: one of the evaluators above, chosen at run time by a tag
+ * rather than through virtual functions, so that the calls in knee recording can be inlined.
+ * LSVineyard keeps a single one and switches it between frames, instead of allocating a new one.
+ */
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::Evaluator: public std::unary_function<Index, RealType>
+{
+    public:
+                                Evaluator(const LSVineyard& v):
+                                    vineyard_(v), kind_(Static), static_(v),
+                                    crossings_(v), simulator_(v)                            {}
+
+        void                    set_static(RealType time)                                   { kind_ = Static;     static_.reset(time); }
+        void                    set_kinetic(const KineticCrossings& c, RealType time_offset, const TrajectoryExtractor& traj)
+                                                                                            { kind_ = Crossings;  crossings_.reset(c, time_offset, traj); }
+        void                    set_kinetic(const KineticSimulator& s, RealType time_offset, const TrajectoryExtractor& traj)
+                                                                                            { kind_ = Simulator;  simulator_.reset(s, time_offset, traj); }
+
+        RealType                time() const
+        {
+            switch (kind_)
+            {
+                case Static:        return static_.time();
+                case Crossings:     return crossings_.time();
+                default:            return simulator_.time();
+            }
+        }
+        RealType                operator()(Index i) const
+        {
+            switch (kind_)
+            {
+                case Static:        return static_(i);
+                case Crossings:     return crossings_(i);
+                default:            return simulator_(i);
+            }
+        }
+        Dimension               dimension(Index i) const                                    { return vineyard_.pfmap(i).dimension(); }
+        RealType                operator()(iterator i) const                                { return operator()(&*i); }
+        Dimension               dimension(iterator i) const                                 { return dimension(&*i); }
+
+    private:
+        enum                    Kind { Static, Crossings, Simulator };
+
+        const LSVineyard&                       vineyard_;
+        Kind                                    kind_;
+        StaticEvaluator                         static_;
+        KineticEvaluator<KineticCrossings>      crossings_;
+        KineticEvaluator<KineticSimulator>      simulator_;
+};
+
 
-template<class V, class VE, class S, class C>
-class LSVineyard<V,VE,S,C>::VertexAttachmentComparison: 
+template<class V, class VE, class S, class C, class CT, class CH>
+class LSVineyard<V,VE,S,C,CT,CH>::VertexAttachmentComparison: 
     public std::binary_function<Vertex, Vertex, bool>
 {
     public:
@@ -343,8 +683,8 @@ class LSVineyard<V,VE,S,C>::VertexAttachmentComparison:
 };
 
 
-template<class V, class VE, class S, class C>
-struct LSVineyard<V,VE,S,C>::AttachmentCmp: 
+template<class V, class VE, class S, class C, class CT, class CH>
+struct LSVineyard<V,VE,S,C,CT,CH>::AttachmentCmp: 
     public std::binary_function<const SimplexPersistenceElementTuple&, const SimplexPersistenceElementTuple&, bool>
 {
     bool        operator()(const SimplexPersistenceElementTuple& t1, const SimplexPersistenceElementTuple& t2) const
@@ -91,10 +91,26 @@ class StaticPersistence
          */
         template<class Filtration>      StaticPersistence(const Filtration& f): ocmp_(order_)   { initialize(f); }
 
+        template<class Filtration, class Boundaries>
+                                        StaticPersistence(const Filtration& f, const std::vector<typename Filtration::Index>& simplices, const Boundaries& boundaries):
+                                            ocmp_(order_)                                       { initialize(f, simplices, boundaries); }
+
         // Function: initialize(const Filtration& f)
         // Initialize the boundary map from the Filtration
         template<class Filtration>
         void                            initialize(const Filtration& f);
+
+        // Function: initialize(const Filtration& f, simplices, boundaries)
+        // Same as initialize(f), but the faces are read off a table instead of looked up in f:
+        // the faces of simplices[i] are simplices[j] for j in [boundaries.boundary_begin(i), boundaries.boundary_end(i))
+        template<class Filtration, class Boundaries>
+        void                            initialize(const Filtration& f, const std::vector<typename Filtration::Index>& simplices, const Boundaries& boundaries);
+
+        // Function: reset(const Filtration& f)
+        // Restore the boundary map from the Filtration, whose order must match the current order,
+        // and unpair all the simplices
+        template<class Filtration>
+        void                            reset(const Filtration& f);
         
         // Function: pair_simplices()                                        
         // Compute persistence of the filtration
@@ -133,6 +149,16 @@ class StaticPersistence
         template<class Visitor>
         void                            pair_simplices(iterator bg, iterator end, bool store_negative = false, const Visitor& visitor = Visitor());
 
+        // Function: pair_simplices_clearing(dimension, visitor)
+        // Compute persistence with the clearing (twist) optimization: the dimensions are reduced 
+        // from the top down, and the column of a simplex that the dimension above has already 
+        // paired as a birth is cleared without any reduction. The pairing is the same as that of 
+        // <pair_simplices()>. The visitor sees no updates for the cleared columns, only init() and 
+        // finished(), and their pair is already set at init(); decompositions that record the updates 
+        // derive the cleared columns from the cycle of the pair instead (see <DynamicPersistenceTrails>).
+        template<class DimensionFunctor, class Visitor>
+        void                            pair_simplices_clearing(const DimensionFunctor& dimension, const Visitor& visitor);
+
         // Struct: PairVisitor
         // Acts as an archetype and if necessary a base class for visitors passed to <pair_simplices(bg, end, visitor)>.
         struct                          PairVisitor
@@ -158,7 +184,7 @@ class StaticPersistence
         
         struct                          PairVisitorNoProgress
         {
-                                        PairVisitorNoProgress()                                 {}
+                                        PairVisitorNoProgress(unsigned = 0)                     {}
             void                        init(iterator i) const                                  {}
             void                        update(iterator j, iterator i) const                    {}
             void                        finished(iterator j) const                              {}
@@ -168,6 +194,9 @@ class StaticPersistence
         const Order&                    order() const                                           { return order_; }
         Order&                          order()                                                 { return order_; }
 
+        template<class Visitor>
+        void                            pair_simplex(iterator j, bool store_negative, const Visitor& visitor);
+
         void                            set_pair(iterator i,    iterator j)                     { set_pair(i, &*j); }
         void                            set_pair(iterator i,    OrderIndex j)                   { order_.modify(i, boost::bind(&OrderElement::set_pair, bl::_1, j)); }                  // i->set_pair(j)
         void                            set_pair(OrderIndex i,  iterator j)                     { set_pair(iterator_to(i), &*j); }
@@ -179,6 +208,24 @@ class StaticPersistence
         OrderComparison                 ocmp_;
 };
 
+/**
+ * Class: SimplexMapDimension
+ * Dimension of the simplex behind an iterator, looked up through a <StaticPersistence::SimplexMap>; 
+ * serves as the DimensionFunctor of <StaticPersistence::pair_simplices_clearing()>.
+ */
+template<class SimplexMap_>
+class SimplexMapDimension
+{
+    public:
+                                        SimplexMapDimension(const SimplexMap_& map): map_(map)  {}
+
+        template<class Iterator>
+        Dimension                       operator()(Iterator i) const                            { return map_[i].dimension(); }
+
+    private:
+        const SimplexMap_&              map_;
+};
+
 #include "static-persistence.hpp"
 
 #endif // __STATIC_PERSISTENCE_H__
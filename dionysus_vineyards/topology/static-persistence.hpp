@@ -1,6 +1,7 @@
 #include <utilities/log.h>
 #include <utilities/containers.h>
 #include <utilities/property-maps.h>
+#include <utilities/profile.h>
 
 #include <boost/utility/enable_if.hpp>
 #include <utilities/boost.h>
@@ -16,6 +17,7 @@ static rlog::RLogChannel* rlPersistence =                   DEF_CHANNEL("topolog
 static Counter*  cPersistencePair =                         GetCounter("persistence/pair");
 static Counter*  cPersistencePairBoundaries =               GetCounter("persistence/pair/boundaries");
 static Counter*  cPersistencePairCycleLength =              GetCounter("persistence/pair/cyclelength");
+static Counter*  cPersistencePairCleared =                  GetCounter("persistence/pair/cleared");
 #endif // COUNTERS
 
 template<class D, class CT, class OT, class E, class Cmp>
@@ -24,9 +26,42 @@ void
 StaticPersistence<D, CT, OT, E, Cmp>::
 initialize(const Filtration& filtration)
 { 
+    Profile::Scope scope(Profile::Boundaries);
     order_.assign(filtration.size(), OrderElement());
     rLog(rlPersistence, "Initializing persistence");
+    reset(filtration);
+}
+
+template<class D, class CT, class OT, class E, class Cmp>
+template<class Filtration, class Boundaries>
+void
+StaticPersistence<D, CT, OT, E, Cmp>::
+initialize(const Filtration& filtration, const std::vector<typename Filtration::Index>& simplices, const Boundaries& boundaries)
+{ 
+    Profile::Scope scope(Profile::Boundaries);
+    order_.assign(filtration.size(), OrderElement());
+    rLog(rlPersistence, "Initializing persistence from a boundary table");
 
+    OffsetMap<typename Filtration::Index, iterator>                         om(filtration.begin(), begin());
+    for (size_t i = 0; i < simplices.size(); ++i)
+    {
+        Cycle z;   
+        for (typename Boundaries::FaceIterator cur = boundaries.boundary_begin(i); cur != boundaries.boundary_end(i); ++cur)
+            z.push_back(index(om[simplices[*cur]]));
+        z.sort(ocmp_); 
+
+        iterator ocur = om[simplices[i]];
+        swap_cycle(ocur, z);
+        set_pair(ocur,   ocur);
+    }
+}
+
+template<class D, class CT, class OT, class E, class Cmp>
+template<class Filtration>
+void
+StaticPersistence<D, CT, OT, E, Cmp>::
+reset(const Filtration& filtration)
+{ 
     OffsetMap<typename Filtration::Index, iterator>                         om(filtration.begin(), begin());
     for (typename Filtration::Index cur = filtration.begin(); cur != filtration.end(); ++cur)
     {
@@ -64,70 +99,115 @@ void
 StaticPersistence<D, CT, OT, E, Cmp>::
 pair_simplices(iterator bg, iterator end, bool store_negative, const Visitor& visitor)
 {
-#if LOGGING
-    typename ContainerTraits::OutputMap outmap(order_);
-#endif
-
-    // FIXME: need sane output for logging
     rLog(rlPersistence, "Entered: pair_simplices");
     for (iterator j = bg; j != end; ++j)
-    {
-        visitor.init(j);
-        rLog(rlPersistence, "Simplex %s", outmap(j).c_str());
+        pair_simplex(j, store_negative, visitor);
+}
 
-        Cycle z;
-        swap_cycle(j, z);
-        rLog(rlPersistence, "  has boundary: %s", z.tostring(outmap).c_str());
+template<class D, class CT, class OT, class E, class Cmp>
+template<class DimensionFunctor, class Visitor>
+void 
+StaticPersistence<D, CT, OT, E, Cmp>::
+pair_simplices_clearing(const DimensionFunctor& dimension, const Visitor& visitor)
+{
+    rLog(rlPersistence, "Entered: pair_simplices_clearing");
 
-        // Sparsify the cycle by removing the negative elements
-        if (!store_negative)
-        {
-            typename OrderElement::Cycle zz;
-            BOOST_FOREACH(OrderIndex i, z)
-                if (i->sign())           // positive
-                    zz.push_back(i);
-            z.swap(zz);
-        }
-        // --------------------------
-        
-        CountNum(cPersistencePairBoundaries, z.size());
-        Count(cPersistencePair);
+    // Columns by dimension, in order
+    std::vector< std::vector<iterator> > columns;
+    for (iterator j = begin(); j != end(); ++j)
+    {
+        Dimension d = dimension(j);
+        AssertMsg(d >= 0, "Dimensions must be non-negative");
+        if (static_cast<size_t>(d) >= columns.size()) columns.resize(d + 1);
+        columns[d].push_back(j);
+    }
 
-        while(!z.empty())
+    // The simplices of the lower dimension are not reduced yet, so their signs are not known:
+    // negative elements have to be kept in the cycles
+    for (Dimension d = columns.size() - 1; d >= 0; --d)
+        for (typename std::vector<iterator>::const_iterator cur = columns[d].begin(); cur != columns[d].end(); ++cur)
         {
-            OrderIndex i = z.top(ocmp_);            // take the youngest element with respect to the OrderComparison
-            rLog(rlPersistence, "  %s: %s", outmap(i).c_str(), outmap(i->pair).c_str());
-            // TODO: is this even a meaningful assert?
-            AssertMsg(!ocmp_(i, index(j)), 
-                      "Simplices in the cycle must precede current simplex: (%s in cycle of %s)",
-                      outmap(i).c_str(), outmap(j).c_str());
-
-            // i is not paired, so we pair j with i
-            if (iterator_to(i->pair) == iterator_to(i))
+            iterator j = *cur;
+            if (iterator_to(j->pair) == j)
+                pair_simplex(j, true, visitor);
+            else
             {
-                rLog(rlPersistence, "  Pairing %s and %s with cycle %s", 
-                                   outmap(i).c_str(), outmap(j).c_str(), 
-                                   z.tostring(outmap).c_str());
-             
-                set_pair(i, j);
+                // j is positive: its reduced column is zero
+                visitor.init(j);
+                Cycle z;
                 swap_cycle(j, z);
-                set_pair(j, i);
-                
-                CountNum(cPersistencePairCycleLength,   j->cycle.size());
-                CountBy (cPersistencePairCycleLength,   j->cycle.size());
-                break;
+                Count(cPersistencePairCleared);
+                visitor.finished(j);
             }
+        }
+}
+
+template<class D, class CT, class OT, class E, class Cmp>
+template<class Visitor>
+void 
+StaticPersistence<D, CT, OT, E, Cmp>::
+pair_simplex(iterator j, bool store_negative, const Visitor& visitor)
+{
+#if LOGGING
+    typename ContainerTraits::OutputMap outmap(order_);
+#endif
+
+    // FIXME: need sane output for logging
+    visitor.init(j);
+    rLog(rlPersistence, "Simplex %s", outmap(j).c_str());
 
-            // update element
-            z.add(i->pair->cycle, ocmp_);
-            visitor.update(j, iterator_to(i));
-            rLog(rlPersistence, "    new cycle: %s", z.tostring(outmap).c_str());
+    Cycle z;
+    swap_cycle(j, z);
+    rLog(rlPersistence, "  has boundary: %s", z.tostring(outmap).c_str());
+
+    // Sparsify the cycle by removing the negative elements
+    if (!store_negative)
+    {
+        typename OrderElement::Cycle zz;
+        BOOST_FOREACH(OrderIndex i, z)
+            if (i->sign())           // positive
+                zz.push_back(i);
+        z.swap(zz);
+    }
+    // --------------------------
+    
+    CountNum(cPersistencePairBoundaries, z.size());
+    Count(cPersistencePair);
+
+    while(!z.empty())
+    {
+        OrderIndex i = z.top(ocmp_);            // take the youngest element with respect to the OrderComparison
+        rLog(rlPersistence, "  %s: %s", outmap(i).c_str(), outmap(i->pair).c_str());
+        // TODO: is this even a meaningful assert?
+        AssertMsg(!ocmp_(i, index(j)), 
+                  "Simplices in the cycle must precede current simplex: (%s in cycle of %s)",
+                  outmap(i).c_str(), outmap(j).c_str());
+
+        // i is not paired, so we pair j with i
+        if (iterator_to(i->pair) == iterator_to(i))
+        {
+            rLog(rlPersistence, "  Pairing %s and %s with cycle %s", 
+                               outmap(i).c_str(), outmap(j).c_str(), 
+                               z.tostring(outmap).c_str());
+         
+            set_pair(i, j);
+            swap_cycle(j, z);
+            set_pair(j, i);
+            
+            CountNum(cPersistencePairCycleLength,   j->cycle.size());
+            CountBy (cPersistencePairCycleLength,   j->cycle.size());
+            break;
         }
-        // if z was empty, so is (already) j->cycle, so nothing to do
-        visitor.finished(j);
-        rLog(rlPersistence, "Finished with %s: %s", 
-                            outmap(j).c_str(), outmap(j->pair).c_str());
+
+        // update element
+        z.add(i->pair->cycle, ocmp_);
+        visitor.update(j, iterator_to(i));
+        rLog(rlPersistence, "    new cycle: %s", z.tostring(outmap).c_str());
     }
+    // if z was empty, so is (already) j->cycle, so nothing to do
+    visitor.finished(j);
+    rLog(rlPersistence, "Finished with %s: %s", 
+                        outmap(j).c_str(), outmap(j->pair).c_str());
 }
 
 template<class D, class CT, class OT, class E, class Cmp>
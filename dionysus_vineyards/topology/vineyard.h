@@ -7,7 +7,9 @@
 #define __VINEYARD_H__
 
 #include "utilities/types.h"
-#include <list>
+#include "utilities/binary-stream.h"
+#include <vector>
+#include <map>
 #include <string>
 
 #include <boost/serialization/access.hpp>
@@ -16,15 +18,24 @@
 #include <boost/serialization/list.hpp>
     
 #include <boost/iterator/iterator_traits.hpp>
+#include <boost/cstdint.hpp>
 
 
 class Knee;
-class Vine;
+class VineyardSink;
+
+// Vines are identified by their index in the vineyard
+typedef                                 unsigned                                        VineId;
+static const VineId                     NoVine = VineId(-1);
 
 /**
  * Vineyard class. Keeps track of vines and knees. switched() is the key function called
  * when pairing switches.
  *
+ * The knees of each dimension are stored as columns (birth, death, time, vine), in the order
+ * they are recorded, so the knees of any one vine appear in order of time. Recording a knee
+ * appends to the columns (or overwrites the vine's last knee); the outputs are linear scans.
+ *
  * \ingroup topology
  */
 template<class Index_, class Iterator_, class Evaluator_>
@@ -35,35 +46,147 @@ class Vineyard
         typedef                         Iterator_                                       Iterator;
         typedef                         Evaluator_                                      Evaluator;
 
-        typedef                         std::list<Vine>                                 VineList;
-        typedef                         std::list<VineList>                             VineListList;
-        typedef                         std::vector<VineListList::iterator>             VineListVector;
+        // A positive simplex, its pair (itself if unpaired), and their vine
+        struct                          LivePair
+        {
+            Index                       birth, death;
+            VineId                      vine;
+        };
+        typedef                         std::vector<LivePair>                           LivePairVector;
                                         
     public:
                                         Vineyard(Evaluator* eval = 0): 
-                                            evaluator(eval)                             {}
+                                            evaluator(eval), dimension(-1), epsilon(0),
+                                            sink(0), sink_buffer(0), flush_at(0),
+                                            recorded(0), deferring(false)               {}
 
         void                            start_vines(Iterator bg, Iterator end);
         void                            switched(Index i, Index j);
         template<class Iter>
-        void                            record_knee(Iter i);
+        Knee                            record_knee(Iter i);                                                // returns the knee of i's pair
         void                            record_diagram(Iterator bg, Iterator end);
 
+        // Simultaneous switches (e.g., at vertices that cross at a common time) move vines among simplices whose values
+        // are all equal, so they would record the same knee over and over. While deferring, switched() only notes the
+        // simplices it gives new vines to; record_deferred() then records the knee of each of their vines once, at the
+        // evaluator's current time. So defer_knees(true) and defer_knees(false) go around a group of simultaneous switches.
+        void                            defer_knees(bool defer)                         { record_deferred(); deferring = defer; }
+        void                            record_deferred();
+
+        // Used when the pairing is recomputed from scratch instead of being updated through switched():
+        // live_pairs() saves the pairs with their vines beforehand, reconnect_vines() reattaches the vines 
+        // afterwards. Unchanged pairs keep their vines; the rest are matched greedily, closest first 
+        // (in L-infinity distance, within the same dimension). Unmatched vines die on the diagonal,
+        // unmatched pairs start new vines from it, both at the given time.
+        void                            live_pairs(Iterator bg, Iterator end, LivePairVector& pairs) const;
+        void                            reconnect_vines(Iterator bg, Iterator end, LivePairVector& previous, RealType time);
+
+        // Appends the vines of next, a vineyard of the frames that follow (with time starting at 0 on the
+        // last frame of this one), shifting their times by time_offset. continuations lists the pairs
+        // (vine live at the end of this vineyard, vine of next that continues it); next is left empty.
+        // A pair (v, NoVine) ends v on the diagonal half a frame later, a pair (NoVine, w) starts w from
+        // the diagonal half a frame earlier.
+        typedef                         std::vector<std::pair<VineId, VineId> >         VineContinuations;
+        void                            stitch(Vineyard& next, const VineContinuations& continuations, RealType time_offset);
+
         void                            set_evaluator(Evaluator* eval)                  { evaluator = eval; }
 
+        // Only the pairs whose positive simplex has dimension d get vines (all the pairs if d is negative);
+        // the rest keep null vines. Must be set before start_vines().
+        void                            set_dimension(Dimension d)                      { dimension = d; }
+
+        // With a positive eps, the knees a vine records while it stays within eps of the diagonal (in persistence,
+        // death - birth) are collapsed: only the first and the last knee of each such stretch are kept. Vines that
+        // never get farther than eps from the diagonal are dropped from the output.
+        void                            set_epsilon(RealType eps)                       { epsilon = eps; }
+
+        // Passes the knees on to sink as they become final, instead of keeping them all: once more than buffer knees
+        // are held, flush() is called. Knees of vines that are still thin (see set_epsilon()) are held back, and dropped
+        // if the vine dies thin. Every recorded diagram is passed on as well. The outputs below then only see the
+        // knees that have not been passed on yet.
+        void                            set_sink(VineyardSink* s, size_t buffer = 0)    { sink = s; sink_buffer = flush_at = buffer; }
+        void                            flush()                                         { flush(false); }  // passes on the final knees
+        void                            finish()                                        { flush(true); }   // passes on all the knees; no more can be recorded
+        void                            report_diagram(Iterator bg, Iterator end) const;                     // passes on the current diagram
+
+        // The current diagram, as report_diagram() passes it on (see VineyardSink::Diagram), with or without a sink
+        void                            current_diagram(Iterator bg, Iterator end, std::vector<std::vector<RealType> >& dgm) const;
+
+        // Writes the vines and their knees (and the settings above, but not the sink) in native binary, for <LSVineyard::save()>;
+        // the knees already passed on to a sink are not part of it. load() replaces the vines with those written by save().
+        void                            save(std::ostream& out) const;
+        void                            load(std::istream& in);
+
         void                            save_edges(const std::string& filename, bool skip_infinite = false) const;
         void                            save_vines(const std::string& filename, bool skip_infinite = false) const;
         std::vector<std::vector<std::vector<double>>>             get_vines(const int& discard) const;
         std::vector<std::vector<std::vector<double>>>             get_dgms(const int& discard, const int& num) const;
 
+        // The vines of get_vines(), flattened: knees holds the rows (birth, death, time), and the knees of the i-th vine,
+        // of dimension dimensions[i], are the rows offsets[i], ..., offsets[i+1] - 1
+        void                            get_flat_vines(const int& discard, std::vector<double>& knees,
+                                                       std::vector<boost::int64_t>& offsets, std::vector<boost::int64_t>& dimensions) const;
+
+        size_t                          knees() const;                                  // total number of knees in all the vines
+        size_t                          knees_recorded() const                          { return recorded; }    // calls to record_knee(), including the knees that were collapsed or overwritten
+
+        // First and last knee of vine v; it must have some
+        Knee                            front(VineId v) const;
+        Knee                            back(VineId v) const;
+
     private:
+        // Knees of one dimension, in the order they were recorded
+        struct                          KneeColumns
+        {
+            std::vector<RealType>       birth, death, time;
+            std::vector<VineId>         vine;
+
+            size_t                      size() const                                    { return vine.size(); }
+            Knee                        operator[](size_t i) const;
+            void                        set(size_t i, const Knee& k);
+            void                        push_back(const Knee& k, VineId v);
+            void                        swap(KneeColumns& other)                        { birth.swap(other.birth); death.swap(other.death); time.swap(other.time); vine.swap(other.vine); }
+        };
+        typedef                         std::vector<KneeColumns>                        KneeColumnsVector;
+
+        struct                          VineRecord
+        {
+            Dimension                   dimension;
+            size_t                      first, last, prev;      // positions of the first, last, and next-to-last knee in the columns
+            size_t                      size;
+            RealType                    persistence;            // largest persistence of any knee recorded so far
+            bool                        dead;                   // no more knees will be added
+        };
+        typedef                         std::vector<VineRecord>                         VineRecordVector;
+
         template<class Iter>
         void                            start_vine(Iter i);
+        VineId                          new_vine(Dimension d);
+        void                            add(VineId v, const Knee& k);
+        void                            set_back(VineId v, const Knee& k);
+        void                            flush(bool all);
+
+        // Positions of the knees of dimension d, grouped by vine: the knees of the i-th vine of the output
+        // (thin vines are skipped) are knees[bounds[i]], ..., knees[bounds[i+1] - 1]
+        void                            grouped_knees(Dimension d, std::vector<size_t>& knees, std::vector<size_t>& bounds) const;
+        template<class Iter>
+        bool                            tracked(Iter i) const                           { return dimension < 0 || evaluator->dimension(i) == dimension; }
+
+        bool                            near_diagonal(const Knee& k) const;
+        bool                            thin(VineId v) const;
+        void                            extend(VineId v, const Knee& k);
 
     private:
-        VineListList                    vines;            // stores vine lists
-        VineListVector                  vines_vector;     // stores pointers (iterators) to vine lists
+        KneeColumnsVector               columns;          // knees, by dimension
+        VineRecordVector                vines;            // indexed by VineId
         Evaluator*                      evaluator;
+        Dimension                       dimension;        // the only dimension that gets vines, if non-negative
+        RealType                        epsilon;          // persistence below which vines are pruned, if positive
+        VineyardSink*                   sink;
+        size_t                          sink_buffer, flush_at;
+        size_t                          recorded;         // knees recorded, see knees_recorded()
+        bool                            deferring;        // see defer_knees()
+        std::vector<Index>              deferred;         // simplices given new vines since the last record_deferred()
 };
 
 /**
@@ -88,6 +211,7 @@ class Knee
 
         bool                    is_diagonal() const                             { return birth == death; }
         bool                    is_infinite() const                             { return (death == Infinity) || (birth == Infinity); }
+        bool                    operator==(const Knee& other) const             { return birth == other.birth && death == other.death && time == other.time; }
 
         std::ostream&           operator<<(std::ostream& out) const             { return out << "(" << birth << ", " 
                                                                                                     << death << ", " 
@@ -103,54 +227,30 @@ class Knee
 std::ostream& operator<<(std::ostream& out, const Knee& k)                      { return k.operator<<(out); }
 
 /**
- * Vine is a list of Knees
+ * Receives the vineyard while it is computed (see Vineyard::set_sink()).
  */
-class Vine: public std::list<Knee>
-{   
+class VineyardSink
+{
     public:
-        typedef                 std::list<Knee>                                 VineRepresentation;
-        typedef                 VineRepresentation::const_iterator              const_knee_iterator;
-        
-                                Vine()                                          {}
-                                Vine(const Vine& other): 
-                                    VineRepresentation(other)                   {}
-                                Vine(const VineRepresentation& other): 
-                                    VineRepresentation(other)                   {}
-                                Vine(const Knee& k)                             { add(k); }
-        
-        void                    add(RealType b, RealType d, RealType t)         { push_back(Knee(b,d,t)); }
-        void                    add(const Knee& k)                              { push_back(k); }
-
-        std::ostream&           operator<<(std::ostream& out) const             { std::copy(begin(), end(), std::ostream_iterator<Knee>(out, " ")); return out; }
-
-        using VineRepresentation::begin;
-        using VineRepresentation::end;
-        using VineRepresentation::front;
-        using VineRepresentation::back;
-        using VineRepresentation::size;
-        using VineRepresentation::empty;
-
-    protected:
-        using VineRepresentation::push_back;
+        typedef                 std::vector<std::vector<RealType> >             Diagram;        // by dimension: birth, death, birth, death, ...
 
-    private:
-        friend class boost::serialization::access;
+        virtual                 ~VineyardSink()                                 {}
 
-        template<class Archive>
-        void                    serialize(Archive& ar, version_type );
+        // Knee k of vine v, of dimension d, is final; the knees of each vine arrive in order of time
+        virtual void            knee(VineId /*v*/, Dimension /*d*/, const Knee& /*k*/)      {}
+        virtual void            diagram(RealType /*time*/, const Diagram& /*dgm*/)          {}
 };
 
-std::ostream& operator<<(std::ostream& out, const Vine& v)                      { return v.operator<<(out); }
-
-
 class VineData
 {
     public:
-        void        set_vine(Vine* vine) const                                          { vine_ = vine; }
-        Vine*       vine() const                                                        { return vine_; }
+                    VineData(): vine_(NoVine)                                           {}
+
+        void        set_vine(VineId vine) const                                         { vine_ = vine; }
+        VineId      vine() const                                                        { return vine_; }
 
     private:
-        mutable Vine*       vine_;      // cheap trick to work around MultiIndex's constness
+        mutable VineId      vine_;      // cheap trick to work around MultiIndex's constness
 };
 
 
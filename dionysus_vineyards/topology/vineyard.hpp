@@ -3,6 +3,7 @@
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <algorithm>
 
 #include "utilities/log.h"
 
@@ -21,12 +22,12 @@ start_vines(Iterator bg, Iterator end)
         if (!cur->sign()) continue;
         Dimension dim = evaluator->dimension(cur);
         
-        if (dim >= vines.size())
+        if (dim >= columns.size())
         {
-            AssertMsg(dim == vines.size(), "New dimension has to be contiguous");
-            vines.push_back(VineList());
-            vines_vector.push_back(boost::prior(vines.end()));
+            AssertMsg(dim == columns.size(), "New dimension has to be contiguous");
+            columns.push_back(KneeColumns());
         }
+        if (!tracked(cur)) continue;
 
         start_vine(cur);
         record_knee(cur);
@@ -40,8 +41,8 @@ switched(Index i, Index j)
 {
     rLog(rlVineyard, "Switching vines");
 
-    Vine* i_vine = i->vine();
-    Vine* j_vine = j->vine();
+    VineId i_vine = i->vine();
+    VineId j_vine = j->vine();
     i->set_vine(j_vine);
     j->set_vine(i_vine);
 
@@ -58,8 +59,47 @@ switched(Index i, Index j)
     // std::cout << "i sign: " << i->sign() << std::endl;
     // std::cout << "j sign: " << j->sign() << std::endl;
 
-    record_knee(i);
-    record_knee(j);
+    if (deferring)
+    {
+        deferred.push_back(i);
+        deferred.push_back(j);
+        return;
+    }
+
+    if (tracked(i)) record_knee(i);
+    if (tracked(j)) record_knee(j);
+}
+
+/// Records the knees of the vines moved since the last call, once per vine, in the order they were first moved
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+record_deferred()
+{
+    if (deferred.empty()) return;
+
+    // Any simplex that got a vine still holds one that moved: a vine only leaves a simplex for another that is noted.
+    // The sign of a simplex may have changed since, but the vine is shared with its pair.
+    typedef     std::pair<VineId, size_t>               VinePosition;
+    std::vector<VinePosition>   moved;
+    for (size_t k = 0; k < deferred.size(); ++k)
+    {
+        Index s = deferred[k]->sign() ? deferred[k] : deferred[k]->pair;
+        deferred[k] = s;
+        if (tracked(s))
+            moved.push_back(VinePosition(s->vine(), k));
+    }
+    std::sort(moved.begin(), moved.end());
+
+    std::vector<size_t>         positions;                      // first position of each vine
+    for (size_t k = 0; k < moved.size(); ++k)
+        if (k == 0 || moved[k].first != moved[k-1].first)
+            positions.push_back(moved[k].second);
+    std::sort(positions.begin(), positions.end());
+    for (size_t k = 0; k < positions.size(); ++k)
+        record_knee(deferred[positions[k]]);
+
+    deferred.clear();
 }
 
 template<class I, class It, class E>
@@ -71,11 +111,253 @@ start_vine(Iter i)
     rLog(rlVineyard, "Starting new vine");
     AssertMsg(i->sign(), "Can only start vines for positive simplices");
         
-    Dimension dim = evaluator->dimension(i);
-    vines_vector[dim]->push_back(Vine());
-    i->set_vine(&vines_vector[dim]->back());
+    i->set_vine(new_vine(evaluator->dimension(i)));
     i->pair->set_vine(i->vine());
 }
+
+template<class I, class It, class E>
+VineId
+Vineyard<I,It,E>::
+new_vine(Dimension d)
+{
+    VineRecord r = { d, 0, 0, 0, 0, 0, false };
+    vines.push_back(r);
+    return vines.size() - 1;
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+add(VineId v, const Knee& k)
+{
+    VineRecord&     r = vines[v];
+    KneeColumns&    c = columns[r.dimension];
+    if (r.size == 0)
+        r.first = c.size();
+    r.prev  = r.last;
+    r.last  = c.size();
+    ++r.size;
+    r.persistence = std::max(r.persistence, k.death - k.birth);
+    c.push_back(k, v);
+
+    if (sink && knees() > flush_at)
+        flush(false);
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+set_back(VineId v, const Knee& k)
+{
+    VineRecord& r = vines[v];
+    columns[r.dimension].set(r.last, k);
+    r.persistence = std::max(r.persistence, k.death - k.birth);
+}
+
+template<class I, class It, class E>
+Knee
+Vineyard<I,It,E>::
+front(VineId v) const
+{
+    AssertMsg(vines[v].size > 0, "Vine must have knees");
+    return columns[vines[v].dimension][vines[v].first];
+}
+
+template<class I, class It, class E>
+Knee
+Vineyard<I,It,E>::
+back(VineId v) const
+{
+    AssertMsg(vines[v].size > 0, "Vine must have knees");
+    return columns[vines[v].dimension][vines[v].last];
+}
+    
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+live_pairs(Iterator bg, Iterator end, LivePairVector& pairs) const
+{
+    pairs.clear();
+    for (Iterator cur = bg; cur != end; ++cur)
+    {
+        if (!cur->sign() || !tracked(cur)) continue;
+        LivePair p = { &*cur, cur->pair, cur->vine() };
+        pairs.push_back(p);
+    }
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+reconnect_vines(Iterator bg, Iterator end, LivePairVector& previous, RealType time)
+{
+    rLog(rlVineyard, "Entered: reconnect_vines()");
+    AssertMsg(evaluator != 0, "Cannot reconnect vines with a null evaluator");
+
+    // Look the pairs up by (the address of) their birth, but leave previous in the order of the filtration:
+    // the matching below breaks ties by that order, so it doesn't depend on where the elements live in memory
+    struct BirthComparison
+    {
+        const LivePairVector&   pairs;
+        bool                    operator()(unsigned i, Index birth) const               { return pairs[i].birth < birth; }
+    };
+    std::vector<unsigned>   by_birth(previous.size());
+    for (unsigned i = 0; i < previous.size(); ++i)
+        by_birth[i] = i;
+    std::sort(by_birth.begin(), by_birth.end(), [&previous](unsigned i, unsigned j) { return previous[i].birth < previous[j].birth; });
+    std::vector<bool>   matched(previous.size(), false);
+
+    // Pairs that have not changed keep their vines
+    LivePairVector      current;
+    for (Iterator cur = bg; cur != end; ++cur)
+    {
+        if (!cur->sign()) continue;
+        if (!tracked(cur))
+        {
+            cur->set_vine(NoVine);
+            cur->pair->set_vine(NoVine);
+            continue;
+        }
+        LivePair p = { &*cur, cur->pair, NoVine };
+        BirthComparison bcmp = { previous };
+        std::vector<unsigned>::const_iterator b = std::lower_bound(by_birth.begin(), by_birth.end(), p.birth, bcmp);
+        if (b != by_birth.end() && previous[*b].birth == p.birth && previous[*b].death == p.death)
+        {
+            p.birth->set_vine(previous[*b].vine);
+            p.death->set_vine(previous[*b].vine);
+            matched[*b] = true;
+        } else
+            current.push_back(p);
+    }
+
+    // Match the rest, closest first
+    struct Candidate
+    {
+        RealType                distance;
+        unsigned                prev, cur;
+        bool                    operator<(const Candidate& other) const
+        {
+            if (distance != other.distance)     return distance < other.distance;
+            if (prev != other.prev)             return prev < other.prev;
+            return cur < other.cur;
+        }
+    };
+    std::vector<Candidate>      candidates;
+    for (unsigned i = 0; i < previous.size(); ++i)
+    {
+        if (matched[i]) continue;
+        Knee k = back(previous[i].vine);
+        for (unsigned j = 0; j < current.size(); ++j)
+        {
+            const LivePair& p = current[j];
+            if (evaluator->dimension(p.birth) != evaluator->dimension(previous[i].birth)) continue;
+
+            RealType birth = (*evaluator)(p.birth);
+            RealType death = (p.death == p.birth) ? Infinity : (*evaluator)(p.death);
+            if ((death == Infinity) != (k.death == Infinity)) continue;
+
+            RealType distance = fabs(birth - k.birth);
+            if (death != Infinity)
+                distance = std::max(distance, fabs(death - k.death));
+            Candidate c = { distance, i, j };
+            candidates.push_back(c);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    std::vector<bool>   taken(current.size(), false);
+    for (typename std::vector<Candidate>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (matched[c->prev] || taken[c->cur]) continue;
+        matched[c->prev] = taken[c->cur] = true;
+        current[c->cur].birth->set_vine(previous[c->prev].vine);
+        current[c->cur].death->set_vine(previous[c->prev].vine);
+    }
+
+    for (unsigned i = 0; i < previous.size(); ++i)
+    {
+        if (matched[i]) continue;
+        vines[previous[i].vine].dead = true;
+        Knee k = back(previous[i].vine);
+        if (k.is_infinite() || k.is_diagonal()) continue;
+        RealType m = (k.birth + k.death)/2;
+        extend(previous[i].vine, Knee(m, m, time));
+    }
+
+    for (unsigned j = 0; j < current.size(); ++j)
+    {
+        if (taken[j]) continue;
+        start_vine(current[j].birth);
+        if (current[j].death == current[j].birth) continue;
+        RealType m = ((*evaluator)(current[j].birth) + (*evaluator)(current[j].death))/2;
+        add(current[j].birth->vine(), Knee(m, m, time));
+    }
+}
+    
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+stitch(Vineyard& next, const VineContinuations& continuations, RealType time_offset)
+{
+    // Continuations keep the ids of the vines they continue, the rest of next's vines get new ones (in the same order)
+    std::vector<VineId>     ids(next.vines.size(), NoVine);
+    std::vector<bool>       born(next.vines.size(), false);
+    for (typename VineContinuations::const_iterator cur = continuations.begin(); cur != continuations.end(); ++cur)
+    {
+        if (cur->second == NoVine)
+        {
+            // Dies on the diagonal, as in reconnect_vines()
+            vines[cur->first].dead = true;
+            Knee k = back(cur->first);
+            if (k.is_infinite() || k.is_diagonal()) continue;
+            RealType m = (k.birth + k.death)/2;
+            extend(cur->first, Knee(m, m, time_offset + .5));
+        } else if (cur->first == NoVine)
+            born[cur->second] = true;
+        else
+            ids[cur->second] = cur->first;
+    }
+    std::vector<bool>       continued(next.vines.size(), false);
+    for (VineId w = 0; w < next.vines.size(); ++w)
+    {
+        if (ids[w] == NoVine)
+            ids[w] = new_vine(next.vines[w].dimension);
+        else
+            continued[w] = true;
+    }
+
+    while (columns.size() < next.columns.size())
+        columns.push_back(KneeColumns());
+
+    for (unsigned d = 0; d < next.columns.size(); ++d)
+    {
+        const KneeColumns& c = next.columns[d];
+        for (size_t j = 0; j < c.size(); ++j)
+        {
+            VineId w = c.vine[j];
+            Knee   k = c[j];
+            k.time += time_offset;
+
+            // Both vines have a knee at the shared frame, unless next's was a lone diagonal knee that got overwritten
+            // (in which case so was this vine's)
+            if (continued[w] && j == next.vines[w].first)
+            {
+                if (k.time != back(ids[w]).time)
+                    set_back(ids[w], k);
+                continue;
+            }
+            if (born[w] && j == next.vines[w].first && !k.is_infinite() && !k.is_diagonal())
+            {
+                RealType m = (k.birth + k.death)/2;
+                add(ids[w], Knee(m, m, k.time - .5));
+            }
+            add(ids[w], k);
+        }
+    }
+
+    next.columns.clear();
+    next.vines.clear();
+}
     
 /// Records the current diagram in the vineyard
 template<class I, class It, class E>
@@ -86,35 +368,158 @@ record_diagram(Iterator bg, Iterator end)
     rLog(rlVineyard, "Entered: record_diagram()");
     AssertMsg(evaluator != 0, "Cannot record diagram with a null evaluator");
     
+    // The diagram for the sink is collected in the same pass (see report_diagram())
+    VineyardSink::Diagram   dgm(sink ? columns.size() : 0);
+    for (Iterator i = bg; i != end; ++i)
+    {
+        if (!i->sign() || !tracked(i))  continue;
+        AssertMsg(i->vine() != NoVine, "Cannot process a null vine in record_diagram");
+        Knee k = record_knee(i);
+        if (!sink || near_diagonal(k))  continue;
+        dgm[evaluator->dimension(i)].push_back(k.birth);
+        dgm[evaluator->dimension(i)].push_back(k.death);
+    }
+    if (sink)
+        sink->diagram(evaluator->time(), dgm);
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+report_diagram(Iterator bg, Iterator end) const
+{
+    if (!sink) return;
+
+    VineyardSink::Diagram   dgm;
+    current_diagram(bg, end, dgm);
+    sink->diagram(evaluator->time(), dgm);
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+current_diagram(Iterator bg, Iterator end, std::vector<std::vector<RealType> >& dgm) const
+{
+    dgm.assign(columns.size(), std::vector<RealType>());
     for (Iterator i = bg; i != end; ++i)
     {
-        AssertMsg(i->vine() != 0, "Cannot process a null vine in record_diagram");
-        if (!i->sign())     continue;
-        record_knee(i);
+        if (!i->sign() || !tracked(i))  continue;
+        Knee k((*evaluator)(i), i->unpaired() ? Infinity : (*evaluator)(i->pair));
+        if (near_diagonal(k))           continue;
+        dgm[evaluator->dimension(i)].push_back(k.birth);
+        dgm[evaluator->dimension(i)].push_back(k.death);
     }
 }
 
+/// Passes the final knees (all of them, if all) on to the sink, and keeps the rest
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+flush(bool all)
+{
+    AssertMsg(sink != 0, "Cannot flush without a sink");
+    size_t kept = 0;
+    for (unsigned d = 0; d < columns.size(); ++d)
+    {
+        KneeColumns& c = columns[d];
+        KneeColumns  rest;
+        for (size_t k = 0; k < c.size(); ++k)
+        {
+            VineId      v = c.vine[k];
+            VineRecord& r = vines[v];
+            bool        done = all || r.dead;
+
+            // Live vines keep their last two knees for record_knee(); thin ones keep everything until they widen or die
+            bool        keep = thin(v) ? !done : !done && (k == r.last || k == r.prev);
+            if (keep)
+            {
+                size_t p = rest.size();
+                if (k == r.first)   r.first = p;
+                if (k == r.prev)    r.prev  = p;
+                if (k == r.last)    r.last  = p;
+                rest.push_back(c[k], v);
+                continue;
+            }
+
+            if (!thin(v))
+                sink->knee(v, d, c[k]);
+            --r.size;
+        }
+        c.swap(rest);
+        kept += c.size();
+    }
+    flush_at = std::max(sink_buffer, 2*kept);
+}
+
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+save(std::ostream& out) const
+{
+    AssertMsg(deferred.empty(), "Knees cannot be deferred when the vineyard is saved");
+    write_binary(out, dimension);
+    write_binary(out, epsilon);
+    write_binary(out, boost::uint64_t(recorded));
+    write_binary(out, boost::uint64_t(columns.size()));
+    for (typename KneeColumnsVector::const_iterator c = columns.begin(); c != columns.end(); ++c)
+    {
+        write_binary(out, c->birth);
+        write_binary(out, c->death);
+        write_binary(out, c->time);
+        write_binary(out, c->vine);
+    }
+    write_binary(out, vines);
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+load(std::istream& in)
+{
+    boost::uint64_t n;
+    read_binary(in, dimension);
+    read_binary(in, epsilon);
+    read_binary(in, n);     recorded = n;
+    read_binary(in, n);
+    columns.assign(n, KneeColumns());
+    for (typename KneeColumnsVector::iterator c = columns.begin(); c != columns.end(); ++c)
+    {
+        read_binary(in, c->birth);
+        read_binary(in, c->death);
+        read_binary(in, c->time);
+        read_binary(in, c->vine);
+        if (c->death.size() != c->size() || c->birth.size() != c->size() || c->time.size() != c->size())
+            throw std::runtime_error("The knees of the vineyard are inconsistent");
+    }
+    read_binary(in, vines);
+    deferred.clear();
+}
 
 template<class I, class It, class E>
 void            
 Vineyard<I,It,E>::
 save_edges(const std::string& filename, bool skip_infinite) const
 {
-    for (unsigned int i = 0; i < vines_vector.size(); ++i)
+    std::vector<size_t> knees, bounds;
+    for (unsigned int i = 0; i < columns.size(); ++i)
     {
         std::ostringstream os; os << i;
         std::string fn = filename + os.str() + ".edg";
         std::ofstream out(fn.c_str());
-        for (typename VineList::const_iterator vi = vines_vector[i]->begin(); vi != vines_vector[i]->end(); ++vi)
-            for (typename Vine::const_iterator ki = vi->begin(), kiprev = ki++; ki != vi->end(); kiprev = ki++)
+        const KneeColumns& c = columns[i];
+        grouped_knees(i, knees, bounds);
+        for (size_t vi = 0; vi + 1 < bounds.size(); ++vi)
+            for (size_t ki = bounds[vi] + 1; ki < bounds[vi+1]; ++ki)
             {
-                if (skip_infinite && (kiprev->is_infinite() || ki->is_infinite()))
+                Knee kprev = c[knees[ki-1]], k = c[knees[ki]];
+                if (skip_infinite && (kprev.is_infinite() || k.is_infinite()))
                 {
                     std::cerr << "Warning: skipping an infinite knee in save_edges() in dimension " << i << std::endl;
                     continue;
                 }
-                out << kiprev->birth << ' ' << kiprev->death << ' ' << kiprev->time << std::endl;
-                out << ki->birth << ' ' << ki->death << ' ' << ki->time << std::endl;
+                out << kprev.birth << ' ' << kprev.death << ' ' << kprev.time << std::endl;
+                out << k.birth << ' ' << k.death << ' ' << k.time << std::endl;
             }
         out.close();
     }
@@ -125,21 +530,25 @@ void
 Vineyard<I,It,E>::
 save_vines(const std::string& filename, bool skip_infinite) const
 {
-    for (unsigned int i = 0; i < vines_vector.size(); ++i)
+    std::vector<size_t> knees, bounds;
+    for (unsigned int i = 0; i < columns.size(); ++i)
     {
         std::ostringstream os; os << i;
         std::string fn = filename + os.str() + ".vin";
         std::ofstream out(fn.c_str());
-        for (typename VineList::const_iterator vi = vines_vector[i]->begin(); vi != vines_vector[i]->end(); ++vi)
+        const KneeColumns& c = columns[i];
+        grouped_knees(i, knees, bounds);
+        for (size_t vi = 0; vi + 1 < bounds.size(); ++vi)
         {
-            for (typename Vine::const_iterator ki = vi->begin(); ki != vi->end(); ki++)
+            for (size_t ki = bounds[vi]; ki < bounds[vi+1]; ++ki)
             {
-                if (skip_infinite && ki->is_infinite())
+                Knee k = c[knees[ki]];
+                if (skip_infinite && k.is_infinite())
                 {
                     std::cerr << "Warning: skipping an infinite knee in save_edges() in dimension " << i << std::endl;
                     continue;
                 }
-                out << ki->birth << ' ' << ki->death << ' ' << ki->time << " ";
+                out << k.birth << ' ' << k.death << ' ' << k.time << " ";
             }
             out << std::endl;
         }
@@ -147,30 +556,40 @@ save_vines(const std::string& filename, bool skip_infinite) const
     }
 }
 
+template<class I, class It, class E>
+size_t
+Vineyard<I,It,E>::
+knees() const
+{
+    size_t count = 0;
+    for (typename KneeColumnsVector::const_iterator c = columns.begin(); c != columns.end(); ++c)
+        count += c->size();
+    return count;
+}
+
 template<class I, class It, class E>
 std::vector<std::vector<std::vector<double>>>            
 Vineyard<I,It,E>::
 get_vines(const int& discard_infinite) const
 {
-    //std::cout << discard_infinite << std::endl;
     std::vector<std::vector<std::vector<double>>> VVV;
-    for (unsigned int i = 0; i < vines_vector.size(); ++i)
+    std::vector<size_t> knees, bounds;
+    for (unsigned int i = 0; i < columns.size(); ++i)
     {
-        std::vector<std::vector<double>> VV;
-        for (typename VineList::const_iterator vi = vines_vector[i]->begin(); vi != vines_vector[i]->end(); ++vi)
+        const KneeColumns& c = columns[i];
+        grouped_knees(i, knees, bounds);
+        std::vector<std::vector<double>> VV(bounds.size() - 1);
+        for (size_t vi = 0; vi < VV.size(); ++vi)
         {
-            std::vector<double> V;
-            for (typename Vine::const_iterator ki = vi->begin(); ki != vi->end(); ki++)
+            std::vector<double>& V = VV[vi];
+            V.reserve(3*(bounds[vi+1] - bounds[vi]));
+            for (size_t ki = bounds[vi]; ki < bounds[vi+1]; ++ki)
             {
-                if (discard_infinite && ki->is_infinite())
-                {
-                    //std::cout << "discarding stuff" << std::endl;
+                size_t k = knees[ki];
+                if (discard_infinite && (c.death[k] == Infinity || c.birth[k] == Infinity))
                     continue;
-                }
-                //std::cout << ki->birth << " " << ki->death << " " << ki->time << std::endl;
-                V.push_back(ki->birth); V.push_back(ki->death); V.push_back(ki->time);
+                V.push_back(c.birth[k]); V.push_back(c.death[k]); V.push_back(c.time[k]);
             }
-            VV.push_back(V);
         }
         VVV.push_back(VV);
     }
@@ -182,69 +601,188 @@ std::vector<std::vector<std::vector<double>>>
 Vineyard<I,It,E>::
 get_dgms(const int& discard_infinite, const int& num) const
 {
-    //std::cout << discard_infinite << std::endl;
     std::vector<std::vector<std::vector<double>>> VVV;
-    for (unsigned int i = 0; i < vines_vector.size(); ++i)
+    std::vector<size_t> knees, bounds;
+    for (unsigned int i = 0; i < columns.size(); ++i)
     {
+        const KneeColumns& c = columns[i];
+        grouped_knees(i, knees, bounds);
         std::vector<std::vector<double>> VV(num);
-        for (typename VineList::const_iterator vi = vines_vector[i]->begin(); vi != vines_vector[i]->end(); ++vi)
+        for (size_t ki = 0; ki < knees.size(); ++ki)
         {
-            for (typename Vine::const_iterator ki = vi->begin(); ki != vi->end(); ki++)
+            size_t k = knees[ki];
+            if (discard_infinite && (c.death[k] == Infinity || c.birth[k] == Infinity))
+                continue;
+            int absulate = abs(c.time[k]);
+            if (absulate == c.time[k]){VV[c.time[k]].push_back(c.birth[k]); VV[c.time[k]].push_back(c.death[k]);}
+        }
+        VVV.push_back(VV);
+    }
+    return VVV;
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+get_flat_vines(const int& discard_infinite, std::vector<double>& knees, std::vector<boost::int64_t>& offsets, std::vector<boost::int64_t>& dimensions) const
+{
+    knees.clear(); offsets.assign(1, 0); dimensions.clear();
+    knees.reserve(3*this->knees());
+    std::vector<size_t> order, bounds;
+    for (unsigned int i = 0; i < columns.size(); ++i)
+    {
+        const KneeColumns& c = columns[i];
+        grouped_knees(i, order, bounds);
+        for (size_t vi = 0; vi + 1 < bounds.size(); ++vi)
+        {
+            for (size_t ki = bounds[vi]; ki < bounds[vi+1]; ++ki)
             {
-                if (discard_infinite && ki->is_infinite())
-                {
-                    //std::cout << "discarding stuff" << std::endl;
+                size_t k = order[ki];
+                if (discard_infinite && (c.death[k] == Infinity || c.birth[k] == Infinity))
                     continue;
-                }
-                //std::cout << ki->birth << " " << ki->death << " " << ki->time << std::endl;
-                int absulate = abs(ki->time);
-                if (absulate == ki->time){VV[ki->time].push_back(ki->birth); VV[ki->time].push_back(ki->death);}
+                knees.push_back(c.birth[k]); knees.push_back(c.death[k]); knees.push_back(c.time[k]);
             }
+            offsets.push_back(knees.size()/3);
+            dimensions.push_back(i);
         }
-        VVV.push_back(VV);
     }
-    return VVV;
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+grouped_knees(Dimension d, std::vector<size_t>& knees, std::vector<size_t>& bounds) const
+{
+    // Counting sort of the column positions by vine
+    std::vector<size_t>     slot(vines.size(), size_t(-1));
+    bounds.assign(1, 0);
+    for (VineId v = 0; v < vines.size(); ++v)
+    {
+        if (vines[v].dimension != d || thin(v)) continue;
+        slot[v] = bounds.size() - 1;
+        bounds.push_back(bounds.back() + vines[v].size);
+    }
+
+    std::vector<size_t>     next(bounds.begin(), bounds.end() - 1);
+    knees.resize(bounds.back());
+    const KneeColumns& c = columns[d];
+    for (size_t k = 0; k < c.size(); ++k)
+    {
+        size_t s = slot[c.vine[k]];
+        if (s != size_t(-1))
+            knees[next[s]++] = k;
+    }
 }
 
 /// Records a knee for the given simplex
 template<class I, class It, class E>
 template<class Iter>
-void
+Knee
 Vineyard<I,It,E>::
 record_knee(Iter i)
 {
     rLog(rlVineyard, "Entered record_knee()");
     AssertMsg(evaluator != 0, "Cannot record knee with a null evaluator");
-    AssertMsg(i->vine() != 0, "Cannot add a knee to a null vine");
+    AssertMsg(i->vine() != NoVine, "Cannot add a knee to a null vine");
     AssertMsg(i->sign(), "record_knee() must be called on a positive simplex");
     
+    ++recorded;
+    VineId v = i->vine();
     if (i->unpaired())
-        i->vine()->add((*evaluator)(i), Infinity, evaluator->time());
+    {
+        Knee k((*evaluator)(i), Infinity, evaluator->time());
+        if (vines[v].size == 0 || !(back(v) == k))
+            add(v, k);
+        rLog(rlVineyard, "Leaving record_knee()");
+        return k;
+    }
     else
     {
         rLog(rlVineyard, "Creating knee");
         Knee k((*evaluator)(i), (*evaluator)((i->pair)), evaluator->time());
         rLog(rlVineyard, "Knee created: %s", tostring(k).c_str());
-        rLog(rlVineyard, "Vine: %s", tostring(*(i->vine())).c_str());
+        rLog(rlVineyard, "Vine: %d, knees: %d", v, vines[v].size);
 
-        if (!k.is_diagonal() || i->vine()->empty())         // non-diagonal k, or empty vine
+        if (vines[v].size > 0 && back(v) == k)              // already recorded, e.g., at the end of the previous frame
+        {
+            rLog(rlVineyard, "Knee already recorded");
+        }
+        else if (!k.is_diagonal() || vines[v].size == 0)    // non-diagonal k, or empty vine
         {
             rLog(rlVineyard, "Extending a vine");
-            i->vine()->add(k);
+            extend(v, k);
         }
-        else if (i->vine()->back().is_diagonal())           // last knee is diagonal
+        else if (back(v).is_diagonal())                     // last knee is diagonal
         {
-            AssertMsg(i->vine()->size() == 1, "Only first knee may be diagonal for a live vine");
+            AssertMsg(vines[v].size == 1, "Only first knee may be diagonal for a live vine");
             rLog(rlVineyard, "Overwriting first diagonal knee");
-            i->vine()->back() = k;
+            set_back(v, k);
         } else                                              // finish this vine
         {
             rLog(rlVineyard, "Finishing a vine");
-            i->vine()->add(k);
+            extend(v, k);
+            vines[v].dead = true;
             start_vine(i);
-            i->vine()->add(k);
+            add(i->vine(), k);
         }
+        rLog(rlVineyard, "Leaving record_knee()");
+        return k;
     }
-    
-    rLog(rlVineyard, "Leaving record_knee()");
+}
+
+template<class I, class It, class E>
+bool
+Vineyard<I,It,E>::
+near_diagonal(const Knee& k) const
+{
+    return epsilon > 0 && !k.is_infinite() && k.death - k.birth <= epsilon;
+}
+
+/// Whether v never got farther than epsilon from the diagonal (always false without epsilon)
+template<class I, class It, class E>
+bool
+Vineyard<I,It,E>::
+thin(VineId v) const
+{
+    return epsilon > 0 && vines[v].persistence <= epsilon;
+}
+
+/// Appends k to v, or replaces v's last knee with it if both that knee and the one before it are near the diagonal
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::
+extend(VineId v, const Knee& k)
+{
+    const VineRecord&   r = vines[v];
+    const KneeColumns&  c = columns[r.dimension];
+    if (near_diagonal(k) && r.size > 1 && near_diagonal(c[r.last]) && near_diagonal(c[r.prev]))
+        set_back(v, k);
+    else
+        add(v, k);
+}
+
+/* KneeColumns */
+template<class I, class It, class E>
+Knee
+Vineyard<I,It,E>::KneeColumns::
+operator[](size_t i) const
+{
+    return Knee(birth[i], death[i], time[i]);
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::KneeColumns::
+set(size_t i, const Knee& k)
+{
+    birth[i] = k.birth; death[i] = k.death; time[i] = k.time;
+}
+
+template<class I, class It, class E>
+void
+Vineyard<I,It,E>::KneeColumns::
+push_back(const Knee& k, VineId v)
+{
+    birth.push_back(k.birth); death.push_back(k.death); time.push_back(k.time);
+    vine.push_back(v);
 }
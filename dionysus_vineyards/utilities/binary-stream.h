@@ -0,0 +1,42 @@
+#ifndef __BINARY_STREAM_H__
+#define __BINARY_STREAM_H__
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+
+/**
+ * Functions: write_binary(out, x), read_binary(in, x)
+ * Plain values, and vectors of them (preceded by their size), in native binary, as in the checkpoints
+ * of <LSVineyard::save()>. read_binary() throws std::runtime_error when the stream runs out.
+ */
+template<class T>
+void        write_binary(std::ostream& out, const T& x)                         { out.write(reinterpret_cast<const char*>(&x), sizeof(T)); }
+
+template<class T>
+void        write_binary(std::ostream& out, const std::vector<T>& v)
+{
+    write_binary(out, boost::uint64_t(v.size()));
+    if (!v.empty())
+        out.write(reinterpret_cast<const char*>(&v[0]), v.size()*sizeof(T));
+}
+
+template<class T>
+void        read_binary(std::istream& in, T& x)
+{
+    if (!in.read(reinterpret_cast<char*>(&x), sizeof(T)))
+        throw std::runtime_error("The binary stream is truncated");
+}
+
+template<class T>
+void        read_binary(std::istream& in, std::vector<T>& v)
+{
+    boost::uint64_t n;
+    read_binary(in, n);
+    v.resize(n);
+    if (n && !in.read(reinterpret_cast<char*>(&v[0]), n*sizeof(T)))
+        throw std::runtime_error("The binary stream is truncated");
+}
+
+#endif // __BINARY_STREAM_H__
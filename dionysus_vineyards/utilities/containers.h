@@ -28,6 +28,9 @@ struct ContainerTraits
     static void reserve(Container& c, size_t sz)                                            {}
     static void sort(Container& c, const Comparison& cmp = Comparison())                    { c.sort(cmp); }
     static void push_front(Container& c, const_reference x)                                 { c.push_front(x); }
+    template<class Iterator>
+    static Iterator find(Iterator bg, Iterator end, const_reference x, const Comparison& cmp)
+    { return std::find(bg, end, x); }
 };
 
 /**
@@ -146,6 +149,12 @@ struct ContainerTraits<vector<T>, Comparison_>
     static void reserve(Container& c, size_t sz)                                            { c.reserve(sz); }
     static void sort(Container& c, const Comparison& cmp = Comparison())                    { std::sort(c.begin(), c.end(), cmp); }
     static void push_front(Container& c, const_reference x)                                 { c.insert(c.begin(), x); }
+    template<class Iterator>
+    static Iterator find(Iterator bg, Iterator end, const_reference x, const Comparison& cmp)
+    {
+        Iterator res = std::lower_bound(bg, end, x, cmp);                   // [bg, end) is sorted with respect to cmp
+        return (res != end && *res == x) ? res : end;
+    }
 };
 
 template<class T, class Comparison_>
@@ -159,6 +168,12 @@ struct ContainerTraits<deque<T>, Comparison_>
     static void reserve(Container& c, size_t sz)                                            { }
     static void sort(Container& c, const Comparison& cmp = Comparison())                    { std::sort(c.begin(), c.end(), cmp); }
     static void push_front(Container& c, const_reference x)                                 { c.push_front(x); }
+    template<class Iterator>
+    static Iterator find(Iterator bg, Iterator end, const_reference x, const Comparison& cmp)
+    {
+        Iterator res = std::lower_bound(bg, end, x, cmp);                   // [bg, end) is sorted with respect to cmp
+        return (res != end && *res == x) ? res : end;
+    }
 };
 
 template<class T, class Comparison_>
@@ -177,6 +192,9 @@ struct ContainerTraits<List<T>, Comparison_>
         std::copy(tmp.begin(), tmp.end(), c.begin());
     }
     static void push_front(Container& c, const_reference x)                                 { c.push_front(x); }
+    template<class Iterator>
+    static Iterator find(Iterator bg, Iterator end, const_reference x, const Comparison& cmp)
+    { return std::find(bg, end, x); }
 };
 
 // TODO: specialize for List (singly-linked list)
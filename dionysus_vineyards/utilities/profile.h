@@ -0,0 +1,82 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <chrono>
+#include <cstddef>
+
+/**
+ * Class: Profile
+ * Number of calls and wall-clock time (std::chrono::steady_clock) of each phase of a vineyard computation.
+ *
+ * A phase is timed by a <Profile::Scope>, which charges it to the profile active on the calling thread,
+ * if any (see <Profile::Activation>); with none active, a scope costs a test. Each thread thus records into
+ * its own profile, without locking, and the profiles of parallel computations are added up once they are done
+ * (so their seconds may add up to more than the elapsed time). Scopes of different phases should not be nested.
+ */
+class Profile
+{
+    public:
+        enum Phase              { Parse, Sort, Boundaries, Attachment, Reduction, Sweep, Extraction, Conversion, Phases };
+
+                                Profile()                                           { for (unsigned p = 0; p < Phases; ++p) { calls_[p] = 0; seconds_[p] = 0; } }
+
+        void                    add(Phase p, double seconds)                        { ++calls_[p]; seconds_[p] += seconds; }
+        size_t                  calls(Phase p) const                                { return calls_[p]; }
+        double                  seconds(Phase p) const                              { return seconds_[p]; }
+
+        Profile&                operator+=(const Profile& other)                    { for (unsigned p = 0; p < Phases; ++p) { calls_[p] += other.calls_[p]; seconds_[p] += other.seconds_[p]; } return *this; }
+
+        static const char*      name(Phase p)                                       { static const char* names[] = { "parse", "sort", "boundaries", "attachment", "reduction", "sweep", "extraction", "conversion" };
+                                                                                      return names[p]; }
+
+        // Function: current()
+        // The profile active on the calling thread (null if none)
+        static Profile*&        current()                                           { static thread_local Profile* profile = 0; return profile; }
+
+        class                   Scope;
+        class                   Activation;
+
+    private:
+        size_t                  calls_[Phases];
+        double                  seconds_[Phases];
+};
+
+/**
+ * Class: Profile::Scope
+ * Charges the time from its construction to its destruction to a phase of the profile active on the thread
+ */
+class Profile::Scope
+{
+    public:
+        typedef                 std::chrono::steady_clock                           Clock;
+
+                                Scope(Phase p): profile_(current()), phase_(p)      { if (profile_) start_ = Clock::now(); }
+                                ~Scope()                                            { if (profile_) profile_->add(phase_, std::chrono::duration<double>(Clock::now() - start_).count()); }
+
+    private:
+                                Scope(const Scope&);
+        Scope&                  operator=(const Scope&);
+
+        Profile*                profile_;
+        Phase                   phase_;
+        Clock::time_point       start_;
+};
+
+/**
+ * Class: Profile::Activation
+ * Makes a profile the active one on the calling thread, for as long as it exists
+ */
+class Profile::Activation
+{
+    public:
+                                Activation(Profile& p): previous_(current())        { current() = &p; }
+                                ~Activation()                                       { current() = previous_; }
+
+    private:
+                                Activation(const Activation&);
+        Activation&             operator=(const Activation&);
+
+        Profile*                previous_;
+};
+
+#endif // __PROFILE_H__
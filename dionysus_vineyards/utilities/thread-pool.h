@@ -0,0 +1,114 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+/**
+ * Class: WorkStealingPool
+ * Runs independent tasks, identified by their index in [0, n), on a fixed number of threads.
+ * Each worker starts with a contiguous block of the indices and takes tasks from the front of
+ * its own queue; once it runs dry, it steals from the back of the fullest queue. Tasks of
+ * uneven cost (e.g., complexes of different sizes) thus stay balanced without a central queue.
+ *
+ * The first exception thrown by a task is rethrown by for_each(), after all workers finish.
+ */
+class WorkStealingPool
+{
+    public:
+                                WorkStealingPool(unsigned threads = 0):
+                                    threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))    {}
+
+        // Function: for_each(n, f)
+        // Calls f(i) for every i in [0, n); blocks until all the calls return
+        template<class Functor>
+        void                    for_each(size_t n, Functor f);
+
+        unsigned                threads() const                                                 { return threads_; }
+
+    private:
+        struct Queue
+        {
+            std::mutex          mutex;
+            std::deque<size_t>  tasks;
+        };
+
+        bool                    pop(Queue& q, size_t& task);
+        bool                    steal(std::vector<Queue>& queues, size_t& task);
+
+        unsigned                threads_;
+};
+
+template<class Functor>
+void
+WorkStealingPool::
+for_each(size_t n, Functor f)
+{
+    unsigned t = std::max<size_t>(1, std::min<size_t>(threads_, n));
+    std::vector<Queue> queues(t);
+    for (unsigned w = 0; w < t; ++w)
+        for (size_t i = w*n/t; i < (w + 1)*n/t; ++i)
+            queues[w].tasks.push_back(i);
+
+    std::mutex          error_mutex;
+    std::exception_ptr  error;
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < t; ++w)
+        workers.emplace_back([&, w]()
+        {
+            size_t task;
+            while (pop(queues[w], task) || steal(queues, task))
+            {
+                try                         { f(task); }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        });
+    for (unsigned w = 0; w < t; ++w)
+        workers[w].join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+inline bool
+WorkStealingPool::
+pop(Queue& q, size_t& task)
+{
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+inline bool
+WorkStealingPool::
+steal(std::vector<Queue>& queues, size_t& task)
+{
+    // No task is ever added, so once every queue looks empty, there is nothing left to steal
+    while (true)
+    {
+        Queue* victim = 0; size_t most = 0;
+        for (size_t w = 0; w < queues.size(); ++w)
+        {
+            std::lock_guard<std::mutex> lock(queues[w].mutex);
+            if (queues[w].tasks.size() > most) { most = queues[w].tasks.size(); victim = &queues[w]; }
+        }
+        if (!victim) return false;
+
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (victim->tasks.empty()) continue;            // somebody got there first
+        task = victim->tasks.back();
+        victim->tasks.pop_back();
+        return true;
+    }
+}
+
+#endif // __THREAD_POOL_H__
@@ -14,7 +14,7 @@ import random
 from concurrent import futures
 from joblib import Parallel, delayed
 
-from dionysus_vineyards import ls_vineyards as lsvine
+from dionysus_vineyards import ls_vineyards as lsvine, LSVineyard
 
 def DTM(X,query_pts,m):
 	"""
@@ -131,7 +131,30 @@ def gudhi_matching(dgm1, dgm2):
 	mtc = np.vstack([mtci, np.vstack(mtcf)]) if len(mtcf) > 0 else mtci
 	return mtc
 
-def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, num_lines=100, corner="dg", extended=False, essential=False, bnds_filt=None, epsilon=1e-10, min_bars=1, noise=0., parallel=True, nproc=4, visu=False, plot_per_bar=False, bnds_visu=None):
+def simplex_arrays(simplextree):
+	"""
+	Simplices of a simplex tree, as a list of per-dimension arrays: the simplices of dimension d are the rows of an array with d+1 columns.
+	This is the in-memory complex format of ls_vineyards.
+	"""
+	return [np.array([s for s,_ in simplextree.get_skeleton(h) if len(s) == h+1], dtype=np.int64).reshape(-1, h+1) for h in range(simplextree.dimension()+1)]
+
+def line_knees(vine):
+	"""
+	Knees of a vine that lie on the lines, i.e., the first knee at each integer time.
+
+	Inputs:
+		vine: Numpy array of knees (birth, death, time), in order of time, as returned by ls_vineyards(..., flat=True)
+
+	Outputs:
+		the rows of vine at integer times, one per time
+	"""
+	t = vine[:,2]
+	knees = vine[t == np.floor(t)]
+	first = np.ones(len(knees), dtype=bool)
+	first[1:] = knees[1:,2] != knees[:-1,2]
+	return knees[first]
+
+def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, num_lines=100, corner="dg", extended=False, essential=False, bnds_filt=None, epsilon=1e-10, min_bars=1, vine_epsilon=0., noise=0., parallel=True, nproc=4, visu=False, plot_per_bar=False, bnds_visu=None, switch_budget=None, max_lines=None, refine_rounds=2):
 	"""
 	Code for computing multiparameter sublevel set persistence. 
 
@@ -147,12 +170,16 @@ def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, nu
 		bnds_filt: bounding rectangle limits
 		epsilon: small shift to avoid horizontal / vertical lines at the beginning of slicing
 		min_bars: minimal number of bars to take summand into account
+		vine_epsilon: vines whose persistence never exceeds vine_epsilon are discarded. Used only if matching is "vineyards"
 		noise: float specifying the amount of random perturbations of slice endpoints
 		parallel: do you want to compute the fibered barcodes and matchings in parallel?
 		nproc: number of cores. Used only if parallel is True
 		visu: do you want to see the decomposition?
 		plot_per_bar: do you want to check each summand individually?
 		bnds_visu: bounding rectangle for visualization
+		switch_budget: if not None, the num_lines lines are only a coarse start: lines are inserted between consecutive lines whose pairings of dimension homology switch more than switch_budget times in the vineyard (counted as the knees of its vines between the two lines), so that regions where the decomposition changes get more lines than flat ones. Used only if matching is "vineyards"
+		max_lines: maximal number of lines after insertion (default: 4 times the initial number). Used only if switch_budget is not None
+		refine_rounds: maximal number of rounds of insertion; each round sweeps again only the segments between the lines it splits, and all the lines are swept once more at the end if any were inserted. Used only if switch_budget is not None
 
 	Outputs:
 		decomposition: the module decomposition
@@ -172,14 +199,7 @@ def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, nu
 					splx.insert([int(v) for v in lline])
 			stfile.close()
 	elif type(simplextree) == gd.SimplexTree:
-		if matching == 'vineyards':
-			with open("simplextree", "w") as stfile:
-				for (s,_) in simplextree.get_skeleton(0):	stfile.write(" ".join([str(v) for v in s]) + "\n")
-				for (s,_) in simplextree.get_filtration():
-					if len(s) > 1:
-						stfile.write(" ".join([str(v) for v in s]) + "\n")
-			stfile.close()
-			splx = "simplextree"
+		if matching == 'vineyards':	splx = simplex_arrays(simplextree)
 		else:	splx = simplextree
 	else:
 		print("simplextree must be string or gudhi SimplexTree")
@@ -202,131 +222,168 @@ def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, nu
 	else:	mins, maxs = [bnds_filt[0], bnds_filt[2]], [bnds_filt[1], bnds_filt[3]]
 	xmt, xMt, ymt, yMt = mins[0], maxs[0], mins[1], maxs[1]
 	
-	lines = []
-
 	if corner == "ll":
 		midal = np.arctan((yMt-ymt)/(xMt-xmt)) 
 		frames = np.concatenate([  np.arctan((np.linspace(start=ymt+epsilon, stop=yMt, num=int(num_lines/2))-ymt)/(xMt-xmt)),
 	                                   np.arctan((yMt-ymt)/(np.linspace(start=xMt, stop=xmt+epsilon, num=int(num_lines/2))-xmt))  ])
-		for i in range(len(frames)):
-			xalpha, yalpha = xmt, ymt
-			xAlpha, yAlpha = min(xMt, xmt + (yMt-ymt)/np.tan(frames[i])), min(yMt, ymt + (xMt-xmt)*np.tan(frames[i]))
-			lines.append(np.array([[xalpha, yalpha, xAlpha, yAlpha]]))
 
 	if corner == "ur":
 		midal = np.arctan((xMt-xmt)/(yMt-ymt))
 		frames = np.concatenate([  np.arctan((xMt-np.linspace(start=xMt-epsilon, stop=xmt, num=int(num_lines/2)))/(yMt-ymt)),
 	                                   np.arctan((xMt-xmt)/(yMt-np.linspace(start=ymt, stop=yMt-epsilon, num=int(num_lines/2))))  ])
-		for i in range(len(frames)):
-			xalpha, yalpha = max(xmt, xMt - (yMt-ymt)*np.tan(frames[i])), max(ymt, yMt - (xMt-xmt)/np.tan(frames[i]))
-			xAlpha, yAlpha = xMt, yMt
-			lines.append(np.array([[xalpha, yalpha, xAlpha, yAlpha]]))
 
 	if corner == "dg":
 		delta = ((xMt-xmt) + (yMt-ymt))/num_lines
 		xs = np.arange(start=xmt, stop=xMt-epsilon, step=delta)[::-1]
 		ys = np.arange(start=ymt+delta, stop=yMt-epsilon, step=delta)
 		frames = [("x", x) for x in xs] + [("y", y) for y in ys]
-		for i in range(len(frames)):
-			xalpha = frames[i][1] if frames[i][0] == "x" else xmt
-			yalpha = frames[i][1] if frames[i][0] == "y" else ymt
+
+	def frame_line(frame):
+		if corner == "ll":
+			xalpha, yalpha = xmt, ymt
+			xAlpha, yAlpha = min(xMt, xmt + (yMt-ymt)/np.tan(frame)), min(yMt, ymt + (xMt-xmt)*np.tan(frame))
+			return np.array([[xalpha, yalpha, xAlpha, yAlpha]])
+		if corner == "ur":
+			xalpha, yalpha = max(xmt, xMt - (yMt-ymt)*np.tan(frame)), max(ymt, yMt - (xMt-xmt)/np.tan(frame))
+			xAlpha, yAlpha = xMt, yMt
+			return np.array([[xalpha, yalpha, xAlpha, yAlpha]])
+		if corner == "dg":
+			xalpha = frame[1] if frame[0] == "x" else xmt
+			yalpha = frame[1] if frame[0] == "y" else ymt
 			xAlpha = xalpha + min(xMt-xalpha, yMt-yalpha)
 			yAlpha = yalpha + min(xMt-xalpha, yMt-yalpha)
-			lines.append(np.array([[xalpha+np.random.uniform(low=0., high=noise*delta), 
+			return np.array([[xalpha+np.random.uniform(low=0., high=noise*delta), 
 						yalpha+np.random.uniform(low=0., high=noise*delta), 
 						xAlpha+np.random.uniform(low=-noise*delta, high=0.), 
-						yAlpha+np.random.uniform(low=-noise*delta, high=0.)]]))
+						yAlpha+np.random.uniform(low=-noise*delta, high=0.)]])
 
-	lines = np.vstack(lines)
-
-	NF = []
-	for i in range(len(frames)):
-		xalpha, yalpha, xAlpha, yAlpha = lines[i,0], lines[i,1], lines[i,2], lines[i,3]
+	def line_filtration(frame, line):
+		xalpha, yalpha, xAlpha, yAlpha = line[0], line[1], line[2], line[3]
 		new_f = []
 		for pt in range(n_pts):
-			if corner == "ll":	u = max( (F1[pt]-xmt) / np.cos(frames[i]), (F2[pt]-ymt) / np.sin(frames[i]) )
-			if corner == "ur":	u = max( max(0,F1[pt]-xalpha)/np.sin(frames[i]), max(0,F2[pt]-yalpha)/np.cos(frames[i]) )
+			if corner == "ll":	u = max( (F1[pt]-xmt) / np.cos(frame), (F2[pt]-ymt) / np.sin(frame) )
+			if corner == "ur":	u = max( max(0,F1[pt]-xalpha)/np.sin(frame), max(0,F2[pt]-yalpha)/np.cos(frame) )
 			if corner == "dg":	u = max( max(0,F1[pt]-xalpha)/(0.5*np.sqrt(2)), max(0,F2[pt]-yalpha)/(0.5*np.sqrt(2)) )
 			new_f.append(u)
-		NF.append([new_f])
-	NF = np.vstack(NF)
+		return np.array(new_f)
+
+	# Frame at fraction t of the way from frame1 to frame2 (the angle for "ll" and "ur", the position along the bottom left boundary for "dg")
+	def frame_between(frame1, frame2, t):
+		if corner != "dg":	return frame1 + t*(frame2-frame1)
+		s1, s2 = [xmt-f[1] if f[0] == "x" else f[1]-ymt for f in [frame1, frame2]]
+		s = s1 + t*(s2-s1)
+		return ("x", xmt-s) if s <= 0 else ("y", ymt+s)
+
+	lines = np.vstack([frame_line(frames[i]) for i in range(len(frames))])
+	NF = np.vstack([line_filtration(frames[i], lines[i])[None,:] for i in range(len(frames))])
 		
 
 	if matching == "vineyards":
 
 		if extended:
 			stbase_ext, stbase = gd.SimplexTree(), gd.SimplexTree()
-			with open(splx, "r") as cplxo:	S = cplxo.readlines()
-			cplxo.close()
-			for line in S:
-				s = [int(c) for c in line.split(" ")]
+			if type(splx) == str:
+				with open(splx, "r") as cplxo:	S = [[int(c) for c in line.split(" ")] for line in cplxo.readlines()]
+			else:	S = [[int(v) for v in s] for splxs in splx for s in splxs]
+			for s in S:
 				stbase.insert(s, -1e10)
 				stbase_ext.insert(s, -1e10)
 			for pt in range(len(filts)):	stbase_ext.assign_filtration([pt], F1[pt])
 			stbase_ext.extend_filtration()
 			list_splx = [(s,f) for (s,f) in stbase_ext.get_filtration()]
 			bary = barycentric_subdivision(stbase_ext, list_splx)
-
-			with open(splx + "_extended.txt", "w") as cplxe:
-				for v in range(bary.num_vertices()):	cplxe.write(str(v) + "\n")
-				for (s,_) in bary.get_filtration():	
-					if len(s) > 1:	cplxe.write(" ".join([str(v) for v in s]) + "\n")
-				cplxe.close()
+			ext_splx = simplex_arrays(bary)
 			efd = []
 
-		NNF = []
-		for i in range(len(frames)):
-
+		def vine_filtration(nf):
 			if extended:
 				st = gd.SimplexTree()
 				for (s,_) in stbase.get_filtration():	st.insert(s, -1e10)
-				for pt in range(n_pts):	st.assign_filtration([pt], NF[i,pt])
+				for pt in range(n_pts):	st.assign_filtration([pt], nf[pt])
 				st.make_filtration_non_decreasing()
 				st.extend_filtration()
 				bary = barycentric_subdivision(st, [(s, st.filtration(s)) for (s, _) in list_splx])
 				new_f = np.array([bary.filtration([v]) for v in range(bary.num_vertices())])
-				efd.append([[min(NF[i,:]), max(NF[i,:])]])
-			else:	new_f = NF[i,:]
+				return new_f, [min(nf), max(nf)]
+			else:	return nf, None
+
+		NNF = []
+		for i in range(len(frames)):
+			new_f, range_f = vine_filtration(NF[i,:])
 			NNF.append(new_f[None,:])
+			if extended:	efd.append([range_f])
 
 		NNF = np.vstack(NNF)
 
 		if extended:	efd = np.vstack(efd)
 
-		if extended:
-			VS = lsvine(NNF, (splx + "_extended.txt").encode('utf-8'), 1)
-		else:
-			if essential:	VS = lsvine(NNF, splx.encode('utf-8'), 0)
-			else:	VS = lsvine(NNF, splx.encode('utf-8'), 1)
+		if extended:	cplx, discard, options = ext_splx, 1, {}
+		else:	cplx, discard, options = splx, 0 if essential else 1, {"homology": homology, "epsilon": vine_epsilon}
 
-		Vs = VS[homology]
+		if switch_budget is None:
+			knees, offsets, dims = lsvine(NNF, cplx, discard, flat=True, **options)
+			vines = [knees[offsets[v]:offsets[v+1]] for v in np.nonzero(dims == homology)[0]]
 
-		decomposition = []
-		for seq in Vs:
-			num_bars = int(len(seq)/3)
-			if num_bars > min_bars:
-				summand = []
-				prevnf = -1
-				for b in range(num_bars):
-					st, ed, nf, nfi = seq[3*b], seq[3*b+1], seq[3*b+2], int(seq[3*b+2])
-					if prevnf == nf or nf-nfi > 0:	continue
-					else:
-						prevnf = nf
-						al = frames[nfi]
-						xalpha, yalpha, xAlpha, yAlpha = lines[nfi,0], lines[nfi,1], lines[nfi,2], lines[nfi,3]
-						if ed == np.inf:	ed = 1e10
-						if extended:
-							m, M = efd[nfi,0], efd[nfi,1]
-							st, ed = -np.abs(st), -np.abs(ed)
-							st, ed = m+(st+2)*(M-m), m+(ed+2)*(M-m)
-						if corner == "ll":
-							summand.append(np.array([[xmt + st*np.cos(al), xmt + ed*np.cos(al), ymt + st*np.sin(al), ymt + ed*np.sin(al), nfi]]))
-						if corner == "ur":
-							summand.append(np.array([[xalpha + st*np.sin(al), xalpha + ed*np.sin(al), yalpha + st*np.cos(al), yalpha + ed*np.cos(al), nfi]]))
-						if corner == "dg":
-							summand.append(np.array([[xalpha+st*(0.5*np.sqrt(2)), xalpha+ed*(0.5*np.sqrt(2)), yalpha+st*(0.5*np.sqrt(2)), yalpha+ed*(0.5*np.sqrt(2)), nfi]]))
+		else:
+			# Sweep the lines with a live vineyard, counting the pairing switches of dimension homology between consecutive lines,
+			# as the knees its vines get strictly between them, and insert evenly spaced lines where they exceed switch_budget,
+			# busiest first; a round sweeps again only the segments it splits, and a last sweep of all the lines gives the vines
+			def sweep(fs):
+				vineyard = LSVineyard(cplx, **options)
+				for f in fs:	vineyard.push_frame(f)
+				all_vines = vineyard.vines(False)
+				vines_h = all_vines[homology] if homology < len(all_vines) else []
+				times = np.concatenate([np.array(v).reshape(-1,3)[:,2] for v in vines_h]) if len(vines_h) > 0 else np.zeros(0)
+				times = times[times != np.floor(times)]
+				return vineyard, np.bincount(np.floor(times).astype(int), minlength=len(fs)-1)
+
+			frames, lines, NNF = list(frames), list(lines), list(NNF)
+			if extended:	efd = list(efd)
+			max_lines = 4*len(frames) if max_lines is None else max_lines
+			vineyard, switches = sweep(NNF)
+			inserted = False
+			for rnd in range(refine_rounds):
+				splits, room = np.maximum(np.ceil(switches/switch_budget).astype(int) - 1, 0), max_lines - len(frames)
+				for i in np.argsort(-switches, kind="stable"):
+					splits[i] = min(splits[i], room)
+					room -= splits[i]
+				if splits.sum() == 0:	break
+				switches = list(switches)
+				for i in np.nonzero(splits)[0][::-1]:
+					new_frames = [frame_between(frames[i], frames[i+1], (j+1)/(splits[i]+1)) for j in range(splits[i])]
+					new_lines = [frame_line(fr)[0] for fr in new_frames]
+					new_fs = [vine_filtration(line_filtration(fr, line)) for fr, line in zip(new_frames, new_lines)]
+					frames[i+1:i+1], lines[i+1:i+1], NNF[i+1:i+1] = new_frames, new_lines, [f for f, _ in new_fs]
+					if extended:	efd[i+1:i+1] = [r for _, r in new_fs]
+					switches[i:i+1] = list(sweep(NNF[i:i+splits[i]+2])[1])
+				switches, inserted = np.array(switches), True
+			if inserted:	vineyard, _ = sweep(NNF)
+
+			if corner != "dg":	frames = np.array(frames)
+			lines = np.vstack(lines)
+			if extended:	efd = np.vstack(efd)
+			all_vines = vineyard.vines(discard)
+			vines = [np.array(v).reshape(-1,3) for v in all_vines[homology]] if homology < len(all_vines) else []
 
-				summand = np.vstack(summand) if len(summand) > 0 else np.empty([0,5])
+		decomposition = []
+		for seq in vines:
+			if len(seq) > min_bars:
+				bars = line_knees(seq)
+				st, ed, nfi = bars[:,0], np.where(bars[:,1] == np.inf, 1e10, bars[:,1]), bars[:,2].astype(int)
+				xalpha, yalpha = lines[nfi,0], lines[nfi,1]
+				if extended:
+					m, M = efd[nfi,0], efd[nfi,1]
+					st, ed = -np.abs(st), -np.abs(ed)
+					st, ed = m+(st+2)*(M-m), m+(ed+2)*(M-m)
+				summand = np.empty([0,5])
+				if corner == "ll":
+					al = frames[nfi]
+					summand = np.column_stack([xmt + st*np.cos(al), xmt + ed*np.cos(al), ymt + st*np.sin(al), ymt + ed*np.sin(al), nfi])
+				if corner == "ur":
+					al = frames[nfi]
+					summand = np.column_stack([xalpha + st*np.sin(al), xalpha + ed*np.sin(al), yalpha + st*np.cos(al), yalpha + ed*np.cos(al), nfi])
+				if corner == "dg":
+					summand = np.column_stack([xalpha+st*(0.5*np.sqrt(2)), xalpha+ed*(0.5*np.sqrt(2)), yalpha+st*(0.5*np.sqrt(2)), yalpha+ed*(0.5*np.sqrt(2)), nfi])
 				decomposition.append(summand)
 
 	else:
@@ -398,7 +455,7 @@ def sublevelsets_multipersistence(matching, simplextree, filters, homology=0, nu
 
 	return decomposition, lines, [xm, xM, ym, yM], [xmt, xMt, ymt, yMt]
 
-def interlevelsets_multipersistence(matching, simplextree, filters, basepoint=None, homology=0, num_lines=100, essential=False, bnds_filt=None, epsilon=1e-10, min_bars=1, parallel=True, nproc=4, visu=False, plot_per_bar=False, bnds_visu=None):
+def interlevelsets_multipersistence(matching, simplextree, filters, basepoint=None, homology=0, num_lines=100, essential=False, bnds_filt=None, epsilon=1e-10, min_bars=1, vine_epsilon=0., parallel=True, nproc=4, visu=False, plot_per_bar=False, bnds_visu=None):
 
 	"""
 	Code for computing multiparameter interlevel set persistence. 
@@ -414,6 +471,7 @@ def interlevelsets_multipersistence(matching, simplextree, filters, basepoint=No
 		bnds_filt: bounding rectangle limits
 		epsilon: small shift to avoid horizontal / vertical lines at the beginning of slicing
 		min_bars: minimal number of bars to take summand into account
+		vine_epsilon: vines whose persistence never exceeds vine_epsilon are discarded. Used only if matching is "vineyards"
 		parallel: do you want to compute the fibered barcodes and matchings in parallel?
 		nproc: number of cores. Used only if parallel is True
 		visu: do you want to see the decomposition?
@@ -437,14 +495,7 @@ def interlevelsets_multipersistence(matching, simplextree, filters, basepoint=No
 					splx.insert([int(v) for v in lline])
 			stfile.close()
 	elif type(simplextree) == gd.SimplexTree:
-		if type(matching) == str:
-			with open("simplextree", "w") as stfile:
-				for (s,_) in simplextree.get_skeleton(0):	stfile.write(" ".join([str(v) for v in s]) + "\n")
-				for (s,_) in simplextree.get_filtration():
-					if len(s) > 1:
-						stfile.write(" ".join([str(v) for v in s]) + "\n")
-			stfile.close()
-			splx = "simplextree"
+		if type(matching) == str:	splx = simplex_arrays(simplextree)
 		else:	splx = simplextree
 	else:
 		print("simplextree must be string or gudhi SimplexTree")
@@ -495,28 +546,17 @@ def interlevelsets_multipersistence(matching, simplextree, filters, basepoint=No
 			NNF.append(NF[i,:][None,:])			
 		NNF = np.vstack(NNF)
 		
-		if essential:	VS = lsvine(NNF, splx.encode('utf-8'), 0)
-		else:	VS = lsvine(NNF, splx.encode('utf-8'), 1)
-
-		Vs = VS[homology]
-
+		if essential:	knees, offsets, dims = lsvine(NNF, splx, 0, homology=homology, epsilon=vine_epsilon, flat=True)
+		else:	knees, offsets, dims = lsvine(NNF, splx, 1, homology=homology, epsilon=vine_epsilon, flat=True)
 
 		decomposition = []
-		for seq in Vs:
-			num_bars = int(len(seq)/3)
-			if num_bars > min_bars:
-				summand = []
-				prevnf = -1
-				for b in range(num_bars):
-					st, ed, nf, nfi = seq[3*b], seq[3*b+1], seq[3*b+2], int(seq[3*b+2])
-					if prevnf == nf or nf-nfi > 0:	continue
-					else:
-						prevnf = nf
-						al = frames[nfi]
-						if ed == np.inf:	ed = 1e10
-						summand.append(np.array([[basepoint + st*np.sin(al), basepoint + ed*np.sin(al), basepoint + st*np.cos(al), basepoint + ed*np.cos(al), nfi]]))
-
-				summand = np.vstack(summand) if len(summand) > 0 else np.empty([0,5])
+		for v in np.nonzero(dims == homology)[0]:
+			seq = knees[offsets[v]:offsets[v+1]]
+			if len(seq) > min_bars:
+				bars = line_knees(seq)
+				st, ed, nfi = bars[:,0], np.where(bars[:,1] == np.inf, 1e10, bars[:,1]), bars[:,2].astype(int)
+				al = frames[nfi]
+				summand = np.column_stack([basepoint + st*np.sin(al), basepoint + ed*np.sin(al), basepoint + st*np.cos(al), basepoint + ed*np.cos(al), nfi])
 				decomposition.append(summand)
 
 	else: